@@ -100,7 +100,7 @@ namespace vtil
 			//
 			make_const_if_t<is_const, basic_block*> block = nullptr;
 			list_entry* entry = nullptr;
-			const path_set* paths_allowed = nullptr;
+			const block_set* paths_allowed = nullptr;
 			bool is_path_restricted = false;
 
 			// Basic constructors.
@@ -250,6 +250,10 @@ namespace vtil
 		//
 		vip_t entry_vip = invalid_vip;
 
+		// Dense index of the block in the reachability index of the owning routine.
+		//
+		uint32_t cfg_index = ~0u;
+
 		// List of all basic blocks that may possibly jump to this basic 
 		// block and basic blocks that we may possibly jump to.
 		//
@@ -294,7 +298,7 @@ namespace vtil
 		basic_block( routine* owner, vip_t entry_vip ) 
 			: owner( owner ), entry_vip( entry_vip ), epoch( make_random<epoch_t>() ) {}
 		basic_block( const basic_block& o )
-			: owner( o.owner ), entry_vip( o.entry_vip ), next( o.next ), prev( o.prev ),
+			: owner( o.owner ), entry_vip( o.entry_vip ), cfg_index( o.cfg_index ), next( o.next ), prev( o.prev ),
 			  sp_index( o.sp_index ), sp_offset( o.sp_offset ), last_temporary_index( o.last_temporary_index ),
 			  label_stack( o.label_stack ), epoch( o.epoch )
 		{
@@ -499,6 +503,13 @@ namespace vtil
 		iterator insert_final( const const_iterator& pos, list_entry* new_entry, bool process );
 	};
 
+	// Checks whether the block set contains the block.
+	//
+	inline bool block_set::contains( const basic_block* blk ) const
+	{
+		return test( blk->cfg_index );
+	}
+
 	// Escape basic block namespace for the iterator type 
 	// for the sake of convinience.
 	//
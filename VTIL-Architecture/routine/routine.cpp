@@ -27,24 +27,47 @@
 //
 #include "routine.hpp"
 #include "basic_block.hpp"
+#include "../trace/cached_tracer.hpp"
 
 namespace vtil
 {
 	// Gets (forward/backward) path from src to dst.
 	//
-	const path_set& routine::get_path( const basic_block* src, const basic_block* dst ) const
+	const block_set& routine::get_path( const basic_block* src, const basic_block* dst ) const
 	{
-		if ( auto it = path_cache.find( src ); it != path_cache.end() )
-			if ( auto it2 = it->second.find( dst ); it2 != it->second.end() )
-				return it2->second;
-		return static_default;
+		if ( !has_path( src, dst ) )
+			return static_default;
+
+		// Return the cached set if already computed.
+		//
+		{
+			std::shared_lock g{ path_cache_mutex };
+			if ( auto it = path_cache.find( src ); it != path_cache.end() )
+				if ( auto it2 = it->second.find( dst ); it2 != it->second.end() )
+					return it2->second;
+		}
+
+		// Otherwise compute the blocks reachable from the source that can reach the destination.
+		//
+		std::unique_lock g{ path_cache_mutex };
+		auto [it, inserted] = path_cache[ src ].try_emplace( dst );
+		if ( inserted )
+			it->second.assign_intersection( reachable_fwd[ src->cfg_index ], reachable_bwd[ dst->cfg_index ] );
+		return it->second;
+	}
+	block_set routine::compute_path( const basic_block* src, const basic_block* dst ) const
+	{
+		block_set result = {};
+		if ( has_path( src, dst ) )
+			result.assign_intersection( reachable_fwd[ src->cfg_index ], reachable_bwd[ dst->cfg_index ] );
+		return result;
 	}
 
 	// Simple helpers to check if (forward/backward) path from src to dst exists.
 	//
 	bool routine::has_path( const basic_block* src, const basic_block* dst ) const
 	{
-		return !get_path( src, dst ).empty();
+		return src->cfg_index < reachable_fwd.size() && reachable_fwd[ src->cfg_index ].test( dst->cfg_index );
 	}
 
 	// Checks whether the block is in a loop.
@@ -57,6 +80,15 @@ namespace vtil
 		return false;
 	}
 
+	// Assigns a dense index to the block, reserved for internal use.
+	//
+	void routine::index_block( basic_block* blk )
+	{
+		blk->cfg_index = ( uint32_t ) reachable_fwd.size();
+		reachable_fwd.emplace_back().set( blk->cfg_index );
+		reachable_bwd.emplace_back().set( blk->cfg_index );
+	}
+
 	// Explores the paths for the block, reserved for internal use.
 	//
 	void routine::explore_paths( const basic_block* blk )
@@ -69,54 +101,49 @@ namespace vtil
 		//
 		signal_cfg_modification();
 
-		// Declare linker.
+		// Declare linker, collecting the blocks gaining new destinations and the blocks
+		// gaining new sources.
 		//
+		block_set sources = {};
+		block_set sinks = {};
 		auto relink = [ & ] ( const basic_block* src, const basic_block* dst )
 		{
-			// Insert direct link.
-			// src => dst
-			//
-			auto& src_links = path_cache[ src ];
-			auto& fwd_d = src_links[ dst ];
-			bool new_f = fwd_d.insert( dst ).second;
-			fwd_d.insert( src );
-
-			// Backward propagate.
-			// src->prev => dst
+			// Skip if the closure already has the edge.
 			//
-			for ( auto& [src2, entry] : path_cache )
-			{
-				if ( auto it = entry.find( src ); it != entry.end() )
-				{
-					path_set& ps = it->second;
-					auto& fwd = entry[ dst ];
-					fwd.insert( ps.begin(), ps.end() );
-					fwd.insert( dst );
-				}
-			}
+			if ( has_path( src, dst ) )
+				return;
 
-			// Forward propagate.
-			// src => dst->next
+			// Every block that can reach src can now reach every block reachable from dst.
 			//
-			auto& dst_links = path_cache[ dst ];
-			for ( auto& [dst2, path] : dst_links )
-			{
-				auto& fwd = src_links[ dst2 ];
-				fwd.insert( path.begin(), path.end() );
-				fwd.insert( src );
-			}
+			block_set fwd = reachable_fwd[ dst->cfg_index ];
+			block_set bwd = reachable_bwd[ src->cfg_index ];
+			bwd.for_each( [ & ] ( uint32_t i ) { reachable_fwd[ i ].merge( fwd ); } );
+			fwd.for_each( [ & ] ( uint32_t i ) { reachable_bwd[ i ].merge( bwd ); } );
+			sources.merge( bwd );
+			sinks.merge( fwd );
 		};
 
-		// Insert self link.
-		//
-		path_cache[ blk ][ blk ].insert( blk );
-
 		// Relink each vertex.
 		//
 		for ( auto next : blk->next )
 			relink( blk, next );
 		for ( auto prev : blk->prev )
 			relink( prev, blk );
+
+		// Update the affected cached paths in-place since references to them may be held, a path
+		// only changes if its source gained new destinations or its destination gained new sources.
+		//
+		if ( !sources.empty() )
+		{
+			std::unique_lock g{ path_cache_mutex };
+			for ( auto& [src, paths] : path_cache )
+			{
+				bool src_changed = sources.test( src->cfg_index );
+				for ( auto& [dst, set] : paths )
+					if ( src_changed || sinks.test( dst->cfg_index ) )
+						set.assign_intersection( reachable_fwd[ src->cfg_index ], reachable_bwd[ dst->cfg_index ] );
+			}
+		}
 	}
 
 	// Flushes the path cache, reserved for internal use.
@@ -131,12 +158,13 @@ namespace vtil
 		//
 		signal_cfg_modification();
 
-		// Reset to only self links.
+		// Reset to only self links, re-assigning the indices.
 		//
-		path_cache.clear();
+		reachable_fwd.clear();
+		reachable_bwd.clear();
 		for_each( [ & ] ( auto blk ) 
 		{ 
-			path_cache[ blk ][ blk ].insert( blk ); 
+			index_block( blk );
 		} );
 
 		// Create vertices.
@@ -145,6 +173,13 @@ namespace vtil
 		{
 			explore_paths( blk );
 		} );
+
+		// Update the cached paths.
+		//
+		std::unique_lock g2{ path_cache_mutex };
+		for ( auto& [src, paths] : path_cache )
+			for ( auto& [dst, set] : paths )
+				set.assign_intersection( reachable_fwd[ src->cfg_index ], reachable_bwd[ dst->cfg_index ] );
 	}
 
 	// Finds a block in the list, get variant will throw if none found.
@@ -188,9 +223,9 @@ namespace vtil
 			block = new basic_block( this, vip );
 			if ( !entry_point ) entry_point = block;
 			
-			// Create self link.
+			// Assign an index with a self link.
 			//
-			path_cache[ block ][ block ].insert( block );
+			index_block( block );
 		}
 
 		// Fix links and explore the path.
@@ -223,46 +258,37 @@ namespace vtil
 		//
 		signal_cfg_modification();
 
-		// Enumerate path_map.
+		// Remove any references from the reachability index, the index itself is not reused 
+		// until the paths are flushed.
 		//
-		for ( auto it = path_cache.begin(); it != path_cache.end(); )
+		if ( block->cfg_index < reachable_fwd.size() )
 		{
-			// If entry key references deleted block, erase it and continue.
-			//
-			if ( it->first == block )
+			for ( auto* sets : { &reachable_fwd, &reachable_bwd } )
 			{
-				it = path_cache.erase( it );
-				continue;
+				( *sets )[ block->cfg_index ].clear();
+				for ( auto& set : *sets )
+					set.reset( block->cfg_index );
 			}
+		}
 
-			// Enumerate std::unordered_map<const basic_block*, path_set>:
-			//
-			for ( auto it2 = it->second.begin(); it2 != it->second.end(); )
+		// Enumerate cached paths.
+		//
+		{
+			std::unique_lock g{ path_cache_mutex };
+			path_cache.erase( block );
+			for ( auto& [src, paths] : path_cache )
 			{
-				// If entry key references deleted block, erase it and continue.
+				// Erase the paths leading to the deleted block and remove any references from the rest.
 				//
-				if ( it2->first == block )
-				{
-					it2 = it->second.erase( it2 );
-					continue;
-				}
-
-				// Remove any references from set.
-				//
-				it2->second.erase( block );
-
-				// Continue iteration.
-				//
-				it2++;
+				paths.erase( block );
+				for ( auto& [dst, set] : paths )
+					set.reset( block->cfg_index );
 			}
-
-			// Continue iteration.
-			//
-			it++;
 		}
 
-		// Remove from explored blocks and delete it.
+		// Evict the block from the tracer caches, remove from explored blocks and delete it.
 		//
+		cached_tracer::evict( block );
 		explored_blocks.erase( block->entry_vip );
 		delete block;
 	}
@@ -459,8 +485,13 @@ namespace vtil
 		{
 			block->next.clear();
 			block->prev.clear();
+			cached_tracer::evict( block );
 			delete std::exchange( block, nullptr );
 		}
+
+		// Release the shared simplifier cache since its entries may refer to the blocks.
+		//
+		symbolic::purge_shared_simplifier_cache();
 	}
 
 	// Clones the routine and it's every block.
@@ -491,23 +522,10 @@ namespace vtil
 					entry = copy->get_block( entry->entry_vip );
 		copy->entry_point = copy->get_block( entry_point->entry_vip );
 
-		// Copy path cache.
+		// Reachability index is shared as the blocks keep their indices, drop the cached paths 
+		// as they are keyed by the original blocks.
 		//
-		for ( const auto& [k1, v] : this->path_cache )
-		{
-			std::unordered_map<const basic_block*, path_set, hasher<>> map_l2;
-			for ( auto& [k2, set] : v )
-			{
-				path_set new_set;
-				std::transform(
-					set.begin(), set.end(),
-					std::inserter( new_set, new_set.begin() ),
-					[ & ] ( const basic_block* block ) { return copy->get_block( block->entry_vip ); }
-				);
-				map_l2.emplace( copy->get_block( k2->entry_vip ), std::move( new_set ) );
-			}
-			copy->path_cache.emplace( copy->get_block( k1->entry_vip ), std::move( map_l2 ) );
-		}
+		copy->path_cache.clear();
 
 		// Fix depth ordered list cache.
 		//
@@ -28,6 +28,7 @@
 #pragma once
 #include <vtil/utility>
 #include <mutex>
+#include <shared_mutex>
 #include <functional>
 #include <unordered_map>
 #include "../arch/identifier.hpp"
@@ -45,14 +46,88 @@ namespace vtil
 	using epoch_t = uint64_t;
 	static constexpr epoch_t invalid_epoch = ~0;
 
-	// Declare types of path containers.
+	// Declare type of block sets.
 	//
 	using path_set = std::unordered_set<const basic_block*, hasher<>>;
-	using path_map = std::unordered_map<
-		const basic_block*, 
-		std::unordered_map<const basic_block*, path_set, hasher<>>, 
-		hasher<>
-	>;
+
+	// Set of blocks of a routine described as a bitmap over the dense block indices.
+	//
+	struct block_set
+	{
+		std::vector<uint64_t> bits;
+
+		// Tests, sets or resets the block with the given index, returns whether the set was changed.
+		//
+		bool test( uint32_t i ) const
+		{
+			return ( i >> 6 ) < bits.size() && ( bits[ i >> 6 ] >> ( i & 63 ) ) & 1;
+		}
+		bool set( uint32_t i )
+		{
+			if ( ( i >> 6 ) >= bits.size() )
+				bits.resize( ( i >> 6 ) + 1 );
+			uint64_t& word = bits[ i >> 6 ];
+			uint64_t mask = 1ull << ( i & 63 );
+			if ( word & mask ) return false;
+			word |= mask;
+			return true;
+		}
+		bool reset( uint32_t i )
+		{
+			if ( ( i >> 6 ) >= bits.size() )
+				return false;
+			uint64_t& word = bits[ i >> 6 ];
+			uint64_t mask = 1ull << ( i & 63 );
+			if ( !( word & mask ) ) return false;
+			word &= ~mask;
+			return true;
+		}
+
+		// Adds every block in the other set to this one.
+		//
+		void merge( const block_set& o )
+		{
+			if ( o.bits.size() > bits.size() )
+				bits.resize( o.bits.size() );
+			for ( size_t n = 0; n != o.bits.size(); n++ )
+				bits[ n ] |= o.bits[ n ];
+		}
+
+		// Assigns the intersection of the given sets.
+		//
+		void assign_intersection( const block_set& a, const block_set& b )
+		{
+			bits.resize( std::min( a.bits.size(), b.bits.size() ) );
+			for ( size_t n = 0; n != bits.size(); n++ )
+				bits[ n ] = a.bits[ n ] & b.bits[ n ];
+		}
+
+		// Invokes the callback with the index of each block in the set.
+		//
+		template<typename T>
+		void for_each( T&& fn ) const
+		{
+			for ( size_t n = 0; n != bits.size(); n++ )
+				for ( uint64_t word = bits[ n ]; word; word &= word - 1 )
+					fn( uint32_t( n * 64 + math::lsb( word ) - 1 ) );
+		}
+
+		// Checks whether the set contains the block, defined in basic_block.hpp.
+		//
+		bool contains( const basic_block* blk ) const;
+
+		// Returns the number of blocks in the set.
+		//
+		size_t size() const
+		{
+			size_t count = 0;
+			for ( uint64_t word : bits )
+				count += math::popcnt( word );
+			return count;
+		}
+		bool empty() const { return std::all_of( bits.begin(), bits.end(), [ ] ( uint64_t word ) { return word == 0; } ); }
+		void clear() { bits.clear(); }
+	};
 
 	// Descriptor for any routine that is being translated.
 	//
@@ -76,9 +151,18 @@ namespace vtil
 		//
 		std::unordered_map<vip_t, basic_block*> explored_blocks;
 
-		// Cache of paths from block A to block B.
+		// Reachability index, each block is assigned a dense index when it is created and the 
+		// transitive closure of the control flow graph is kept as a bitmap of the blocks reachable
+		// from each block and of the blocks each block is reachable from.
 		//
-		path_map path_cache;
+		std::vector<block_set> reachable_fwd;
+		std::vector<block_set> reachable_bwd;
+
+		// Cache of paths from block A to block B grouped by block A, computed on demand and updated 
+		// in-place, only holds the paths requested through ::get_path.
+		//
+		mutable std::unordered_map<const basic_block*, std::unordered_map<const basic_block*, block_set, hasher<>>, hasher<>> path_cache;
+		mutable relaxed<std::shared_mutex> path_cache_mutex;
 
 		// Reference to the first block, entry point.
 		// - Can be accessed without acquiring the mutex as it will be assigned strictly once.
@@ -197,9 +281,13 @@ namespace vtil
 			spec_subroutine_conventions[ vip ] = cc;
 		}
 
-		// Gets path from src to dst.
+		// Gets the set of blocks on the paths from src to dst.
+		// - The set is cached for the lifetime of the routine and kept up to date as edges are added so
+		//   that path-restricted iterators can refer to it, ::compute_path should be used if it is
+		//   not retained.
 		//
-		const path_set& get_path( const basic_block* src, const basic_block* dst ) const;
+		const block_set& get_path( const basic_block* src, const basic_block* dst ) const;
+		block_set compute_path( const basic_block* src, const basic_block* dst ) const;
 
 		// Simple helpers to check if path from src to dst exists.
 		//
@@ -209,6 +297,10 @@ namespace vtil
 		//
 		bool is_looping( const basic_block* blk ) const;
 
+		// Assigns a dense index to the block, reserved for internal use.
+		//
+		void index_block( basic_block* blk );
+
 		// Explores the paths for the block, reserved for internal use.
 		//
 		void explore_paths( const basic_block* blk );
@@ -228,6 +320,8 @@ namespace vtil
 		std::pair<basic_block*, bool> create_block( vip_t vip, basic_block* src = nullptr );
 
 		// Deletes a block, should have no links or links must be nullified (no back-links).
+		// - Paths that went through the block are kept in the reachability index, ::flush_paths 
+		//   should be called if the deletion disconnects other blocks.
 		//
 		void delete_block( basic_block* block );
 
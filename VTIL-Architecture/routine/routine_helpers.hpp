@@ -131,10 +131,12 @@ namespace vtil
 		// Allocate a visit list and fetch allowed list for the path if relevant.
 		//
 		path_set set = {};
-		const path_set* set_allowed;
+		block_set path = {};
+		const block_set* set_allowed;
 		if ( dst.is_valid() )
 		{
-			set_allowed = &src.block->owner->get_path( src.block, dst.block );
+			path = src.block->owner->compute_path( src.block, dst.block );
+			set_allowed = &path;
 			set.reserve( set_allowed->size() );
 		}
 		else
@@ -178,10 +180,12 @@ namespace vtil
 		// Allocate a visit list and fetch allowed list for the path if relevant.
 		//
 		path_set set = {};
-		const path_set* set_allowed;
+		block_set path = {};
+		const block_set* set_allowed;
 		if ( dst.is_valid() )
 		{
-			set_allowed = &src.block->owner->get_path( dst.block, src.block );
+			path = src.block->owner->compute_path( dst.block, src.block );
+			set_allowed = &path;
 			set.reserve( set_allowed->size() );
 		}
 		else
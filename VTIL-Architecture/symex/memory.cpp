@@ -30,6 +30,156 @@
 
 namespace vtil::symbolic
 {
+	// Gap between the orders of entries appended to the store.
+	//
+	static constexpr uint64_t order_gap = 1ull << 32;
+
+	// Splits the pointer base into the non-constant part and the constant displacement from it.
+	//
+	static std::pair<expression::reference, int64_t> split_displacement( const expression::reference& base )
+	{
+		if ( base->is_constant() )
+			return { expression::reference{ 0ull, base->size() }, *base->get<true>() };
+
+		switch ( base->op )
+		{
+			case math::operator_id::add:
+				if ( base->rhs->is_constant() )
+					return { base->lhs, *base->rhs->get<true>() };
+				if ( base->lhs->is_constant() )
+					return { base->rhs, *base->lhs->get<true>() };
+				break;
+			case math::operator_id::subtract:
+				if ( base->rhs->is_constant() )
+					return { base->lhs, -*base->rhs->get<true>() };
+				break;
+			default:
+				break;
+		}
+		return { base, 0 };
+	}
+
+	// Inserts or removes the entry from the index, reserved for internal use.
+	//
+	void memory::index_insert( store_type::iterator it, uint64_t order )
+	{
+		auto [base, offset] = split_displacement( it->first.base );
+		store_group& group = group_index[ base ];
+		group.flags = it->first.flags;
+		entry_index[ &*it ] = { &group, group.entries.emplace( offset, it ), order };
+	}
+	void memory::index_erase( store_type::iterator it )
+	{
+		auto entry = entry_index.find( &*it );
+		store_group* group = entry->second.group;
+		group->entries.erase( entry->second.position );
+		entry_index.erase( entry );
+
+		// Remove the group as well if it has no entries left.
+		//
+		if ( group->entries.empty() )
+			group_index.erase( split_displacement( it->first.base ).first );
+	}
+
+	// Allocates an order for an entry to be inserted before the given position, reserved for internal use.
+	//
+	uint64_t memory::allocate_order( store_type::iterator it )
+	{
+		uint64_t low = it == value_map.begin() ? 0 : entry_index.at( &*std::prev( it ) ).order;
+		uint64_t high = it == value_map.end() ? low + 2 * order_gap : entry_index.at( &*it ).order;
+
+		// If there is no space left between the neighbours, renumber the entries and retry.
+		//
+		if ( ( high - low ) < 2 || high < low )
+		{
+			uint64_t order = 0;
+			for ( auto& entry : value_map )
+				entry_index.at( &entry ).order = ( order += order_gap );
+			return allocate_order( it );
+		}
+		return it == value_map.end() ? low + order_gap : low + ( high - low ) / 2;
+	}
+
+	// Rebuilds the index from the store.
+	//
+	void memory::rebuild_index()
+	{
+		group_index.clear();
+		entry_index.clear();
+
+		uint64_t order = 0;
+		for ( auto it = value_map.begin(); it != value_map.end(); it++ )
+			index_insert( it, order += order_gap );
+	}
+
+	// Invokes the enumerator for each entry that may alias the given region along with its bit
+	// distance in the order of a backwards scan over the store, skipping entries that cannot.
+	//
+	void memory::enumerate_aliases( const pointer& ptr, bitcnt_t size, fn_calc_distance distance, 
+									function_view<bool( uncertain<bitcnt_t>, store_type::const_iterator )> fn ) const
+	{
+		// If a custom distance calculator is given, scan the store.
+		//
+		if ( distance )
+		{
+			for ( auto it = value_map.rbegin(); it != value_map.rend(); it++ )
+			{
+				auto bit_distance = distance( it->first, ptr );
+				if ( !bit_distance.is_null() && !fn( bit_distance, std::prev( it.base() ) ) )
+					break;
+			}
+			return;
+		}
+
+		stack_vector<std::tuple<uint64_t, uncertain<bitcnt_t>, store_type::const_iterator>, 16> candidates;
+
+		// Entries sharing the non-constant part of the pointer are at a known distance, so only 
+		// the ones that start within the reach of a 64-bit access can overlap.
+		//
+		auto [base, offset] = split_displacement( ptr.base );
+		const store_group* same_group = nullptr;
+		if ( auto it = group_index.find( base ); it != group_index.end() )
+		{
+			same_group = &it->second;
+			auto& entries = same_group->entries;
+			int64_t limit = offset + ( size + 7 ) / 8;
+			for ( auto it2 = entries.upper_bound( offset - 8 ); it2 != entries.end() && it2->first < limit; it2++ )
+			{
+				candidates.emplace_back(
+					entry_index.at( &*it2->second ).order,
+					math::narrow_cast<bitcnt_t>( ( it2->first - offset ) * 8 ),
+					it2->second
+				);
+			}
+		}
+
+		// Entries of the other groups are checked one by one unless the flags of the pointers 
+		// cannot overlap, see pointer::can_overlap.
+		//
+		for ( auto& [group_base, group] : group_index )
+		{
+			if ( &group == same_group )
+				continue;
+
+			uint64_t common_flags = group.flags & ptr.flags;
+			if ( common_flags != group.flags && common_flags != ptr.flags )
+				continue;
+
+			for ( auto& [group_offset, it] : group.entries )
+			{
+				if ( auto bit_distance = memory::bit_distance( it->first, ptr ); !bit_distance.is_null() )
+					candidates.emplace_back( entry_index.at( &*it ).order, bit_distance, it );
+			}
+		}
+
+		// Invoke the enumerator from the latest entry to the earliest one.
+		//
+		std::sort( candidates.begin(), candidates.end(), [ ] ( auto& a, auto& b ) { return std::get<0>( a ) > std::get<0>( b ); } );
+		for ( auto& [order, bit_distance, it] : candidates )
+			if ( !fn( bit_distance, it ) )
+				break;
+	}
+
 	// Returns the mask of known/unknown bits of the given region, if alias failure occurs returns nullopt.
 	//
 	std::optional<uint64_t> memory::known_mask( const pointer& ptr, bitcnt_t size, fn_calc_distance distance ) const
@@ -42,28 +192,31 @@ namespace vtil::symbolic
 	std::optional<uint64_t> memory::unknown_mask( const pointer& ptr, bitcnt_t size, fn_calc_distance distance ) const
 	{
 		uint64_t mask_pending = math::fill( size );
+		bool alias_failure = false;
 
-		// For each entry, iterating backwards:
+		// For each entry that may alias, iterating backwards:
 		//
-		for ( auto it = value_map.rbegin(); it != value_map.rend() && mask_pending; it++ )
+		if ( mask_pending )
 		{
-			auto bit_distance = distance( it->first, ptr );
-
-			// If pointer cannot overlap lookup, skip.
-			//
-			if ( bit_distance.is_null() )
-				continue;
-
-			// If unknown:
-			//
-			if ( bit_distance.is_unknown() )
-				return std::nullopt;
+			enumerate_aliases( ptr, size, distance, [ & ] ( uncertain<bitcnt_t> bit_distance, store_type::const_iterator it )
+			{
+				// If unknown, indicate alias failure.
+				//
+				if ( bit_distance.is_unknown() )
+				{
+					alias_failure = true;
+					return false;
+				}
 
-			// Calculate relative mask, clear pending mask.
-			//
-			uint64_t relative_mask = math::fill( it->second.size(), *bit_distance );
-			mask_pending &= ~relative_mask;
+				// Calculate relative mask, clear pending mask.
+				//
+				uint64_t relative_mask = math::fill( it->second.size(), *bit_distance );
+				mask_pending &= ~relative_mask;
+				return mask_pending != 0;
+			} );
 		}
+		if ( alias_failure )
+			return std::nullopt;
 		return mask_pending;
 	}
 
@@ -77,45 +230,48 @@ namespace vtil::symbolic
 
 		uint64_t mask_pending = math::fill( size );
 		stack_vector<std::pair<bitcnt_t, expression::reference>, 8> merge_list;
+		bool alias_failure = false;
 
-		// For each entry, iterating backwards:
+		// For each entry that may alias, iterating backwards:
 		//
-		for ( auto it = value_map.rbegin(); it != value_map.rend() && mask_pending; it++ )
+		if ( mask_pending )
 		{
-			auto bit_distance = distance( it->first, ptr );
-
-			// If pointer cannot overlap lookup, skip.
-			//
-			if ( bit_distance.is_null() )
-				continue;
-
-			// If unknown:
-			//
-			if ( bit_distance.is_unknown() )
+			enumerate_aliases( ptr, size, distance, [ & ] ( uncertain<bitcnt_t> bit_distance, store_type::const_iterator it )
 			{
-				// If not relaxed aliasing, indicate alias failure by returning null.
+				// If unknown:
 				//
-				if ( !relaxed_aliasing )
-					return nullptr;
+				if ( bit_distance.is_unknown() )
+				{
+					// If not relaxed aliasing, indicate alias failure.
+					//
+					if ( !relaxed_aliasing )
+						alias_failure = true;
 
-				// Otherwise, return default value, cannot be determined.
-				//
-				merge_list.clear();
-				break;
-			}
+					// Otherwise, return default value, cannot be determined.
+					//
+					merge_list.clear();
+					return false;
+				}
 
-			// Calculate relative mask, skip if not overlapping.
-			//
-			uint64_t relative_mask = math::fill( it->second.size(), *bit_distance );
-			if ( !( relative_mask & mask_pending ) )
-				continue;
+				// Calculate relative mask, skip if not overlapping.
+				//
+				uint64_t relative_mask = math::fill( it->second.size(), *bit_distance );
+				if ( !( relative_mask & mask_pending ) )
+					return true;
 
-			// Add into merge list, clear the mask.
-			//
-			merge_list.emplace_back( *bit_distance, it->second );
-			mask_pending &= ~relative_mask;
+				// Add into merge list, clear the mask.
+				//
+				merge_list.emplace_back( *bit_distance, it->second );
+				mask_pending &= ~relative_mask;
+				return mask_pending != 0;
+			} );
 		}
 
+		// If alias failure occured, return null.
+		//
+		if ( alias_failure )
+			return nullptr;
+
 		// If no overlapping keys found, return default.
 		//
 		*contains = math::fill( size ) & ~mask_pending;
@@ -150,50 +306,57 @@ namespace vtil::symbolic
 	optional_reference<expression::reference> memory::write( const pointer& ptr, deferred_value<expression::reference> value, bitcnt_t size, fn_calc_distance distance )
 	{
 		uint64_t mask_pending = math::fill( size );
-		stack_vector<std::pair<bitcnt_t, store_type::iterator>, 8> acquisition_list;
+		stack_vector<std::pair<bitcnt_t, store_type::const_iterator>, 8> acquisition_list;
+		bool alias_failure = false;
 
-		// For each entry, iterating backwards:
+		// For each entry that may alias, iterating backwards:
 		//
-		for ( auto it = value_map.rbegin(); it != value_map.rend() && mask_pending; it++ )
+		if ( mask_pending )
 		{
-			auto bit_distance = distance( it->first, ptr );
-
-			// If pointer cannot overlap lookup, skip.
-			//
-			if ( bit_distance.is_null() )
-				continue;
-
-			// If unknown:
-			//
-			if ( bit_distance.is_unknown() )
+			enumerate_aliases( ptr, size, distance, [ & ] ( uncertain<bitcnt_t> bit_distance, store_type::const_iterator it )
 			{
-				// If not relaxed aliasing, indicate alias failure by returning null.
+				// If unknown:
 				//
-				if ( !relaxed_aliasing )
-					return std::nullopt;
+				if ( bit_distance.is_unknown() )
+				{
+					// If not relaxed aliasing, indicate alias failure.
+					//
+					if ( !relaxed_aliasing )
+						alias_failure = true;
 
-				// Otherwise, insert at the end, overlaps can't be determined.
-				//
-				acquisition_list.clear();
-				break;
-			}
+					// Otherwise, insert at the end, overlaps can't be determined.
+					//
+					acquisition_list.clear();
+					return false;
+				}
 
-			// Calculate relative mask, skip if not overlapping.
-			//
-			uint64_t relative_mask = math::fill( it->second.size(), *bit_distance );
-			if ( !( relative_mask & mask_pending ) )
-				continue;
+				// Calculate relative mask, skip if not overlapping.
+				//
+				uint64_t relative_mask = math::fill( it->second.size(), *bit_distance );
+				if ( !( relative_mask & mask_pending ) )
+					return true;
 
-			// Add into acquisition list, clear the mask.
-			//
-			acquisition_list.emplace_back( *bit_distance, std::prev( it.base() ) );
-			mask_pending &= ~relative_mask;
+				// Add into acquisition list, clear the mask.
+				//
+				acquisition_list.emplace_back( *bit_distance, it );
+				mask_pending &= ~relative_mask;
+				return mask_pending != 0;
+			} );
 		}
 
+		// If alias failure occured, return null.
+		//
+		if ( alias_failure )
+			return std::nullopt;
+
 		// For each iterator we should acquire bits from:
 		//
-		for ( auto& [dst, it] : acquisition_list )
+		for ( auto& [dst, cit] : acquisition_list )
 		{
+			// Convert to a mutable iterator.
+			//
+			store_type::iterator it = value_map.erase( cit, cit );
+
 			// If low bits start at or above our pointer:
 			// | v v v v         |  v v v v		|
 			// |     a b c d ... |  a b c d ... |
@@ -207,15 +370,19 @@ namespace vtil::symbolic
 				//
 				if ( new_size <= 0 )
 				{
+					index_erase( it );
 					value_map.erase( it );
 					continue;
 				}
 
-				// Shift and resize the entry.
+				// Shift and resize the entry, re-index since the pointer changed.
 				//
+				uint64_t order = entry_index.at( &*it ).order;
+				index_erase( it );
 				it->first = std::move( it->first ) + ( strip_low_cnt / 8 );
 				it->second >>= strip_low_cnt;
 				it->second.resize( new_size );
+				index_insert( it, order );
 			}
 			// If high bits end before or at our region limits:
 			// |         v v v v |      v v v v	 |
@@ -239,11 +406,13 @@ namespace vtil::symbolic
 
 				// Split high value.
 				//
-				value_map.emplace(
+				uint64_t order = allocate_order( it );
+				auto high_it = value_map.emplace(
 					it,
 					it->first + ( high_offset / 8 ),
 					( it->second >> high_offset ).resize( high_size )
 				);
+				index_insert( high_it, order );
 
 				// Resize low value.
 				//
@@ -253,6 +422,9 @@ namespace vtil::symbolic
 
 		// Insert new value.
 		//
-		return value_map.emplace_back( ptr, value.get() ).second;
+		uint64_t order = allocate_order( value_map.end() );
+		auto& entry = value_map.emplace_back( ptr, value.get() );
+		index_insert( std::prev( value_map.end() ), order );
+		return entry.second;
 	}
 };
\ No newline at end of file
@@ -28,6 +28,8 @@
 #pragma once
 #include <vtil/utility>
 #include <list>
+#include <map>
+#include <unordered_map>
 #include "pointer.hpp"
 #include "variable.hpp"
 #include "../arch/register_desc.hpp"
@@ -55,22 +57,51 @@ namespace vtil::symbolic
 			return byte_distance ? uncertain{ math::narrow_cast<bitcnt_t>( *byte_distance * 8 ) } : uncertain_t::unknown;
 		}
 
-		// The memory state.
+		// Entries of the store grouped by the non-constant part of their pointer, ordered by the 
+		// constant displacement from it.
+		//
+		struct store_group
+		{
+			uint64_t flags = 0;
+			std::multimap<int64_t, store_type::iterator> entries;
+		};
+		using group_map =                std::unordered_map<expression::reference, store_group, expression::reference::hasher, expression::reference::if_identical>;
+
+		// Position of an entry in the index, order is increasing with the position in the store.
+		//
+		struct index_entry
+		{
+			store_group* group;
+			std::multimap<int64_t, store_type::iterator>::iterator position;
+			uint64_t order;
+		};
+		using index_map =                std::unordered_map<const store_entry*, index_entry>;
+
+		// The memory state, the keys of the store should not be modified without going through 
+		// the interface as the index would be left out of sync.
 		//
 		bool relaxed_aliasing;
 		store_type value_map;
+		group_map group_index;
+		index_map entry_index;
 
 		// Default constructor, optionally takes a boolean to indicate relaxed aliasing.
 		//
 		memory( bool relaxed_aliasing = false )
 			: relaxed_aliasing( relaxed_aliasing ) {}
 
-		// Default copy/move.
+		// Default move, copy rebuilds the index.
 		//
 		memory( memory&& ) = default;
-		memory( const memory& ) = default;
+		memory( const memory& o ) : relaxed_aliasing( o.relaxed_aliasing ), value_map( o.value_map ) { rebuild_index(); }
 		memory& operator=( memory&& ) = default;
-		memory& operator=( const memory& ) = default;
+		memory& operator=( const memory& o )
+		{
+			relaxed_aliasing = o.relaxed_aliasing;
+			value_map = o.value_map;
+			rebuild_index();
+			return *this;
+		}
 
 		// Wrap around the store type.
 		//
@@ -79,21 +110,42 @@ namespace vtil::symbolic
 		auto begin() const { return value_map.cbegin(); }
 		auto end() const { return value_map.cend(); }
 		size_t size() const { return value_map.size(); }
-		void reset() { value_map.clear(); }
+		void reset() { value_map.clear(); group_index.clear(); entry_index.clear(); }
+
+		// Invokes the enumerator for each entry that may alias the given region along with its bit
+		// distance in the order of a backwards scan over the store, skipping entries that cannot.
+		// - If no distance calculator is given, the default aliasing rules of ::bit_distance are
+		//   applied using the index, otherwise the whole store is scanned.
+		//
+		void enumerate_aliases( const pointer& ptr, bitcnt_t size, fn_calc_distance distance, 
+								function_view<bool( uncertain<bitcnt_t>, store_type::const_iterator )> fn ) const;
+
+		// Rebuilds the index from the store.
+		//
+		void rebuild_index();
 
 		// Returns the mask of known/unknown bits of the given region, if alias failure occurs returns nullopt.
 		// 
-		std::optional<uint64_t> known_mask( const pointer& ptr, bitcnt_t size, fn_calc_distance distance = bit_distance ) const;
-		std::optional<uint64_t> unknown_mask( const pointer& ptr, bitcnt_t size, fn_calc_distance distance = bit_distance ) const;
+		std::optional<uint64_t> known_mask( const pointer& ptr, bitcnt_t size, fn_calc_distance distance = {} ) const;
+		std::optional<uint64_t> unknown_mask( const pointer& ptr, bitcnt_t size, fn_calc_distance distance = {} ) const;
 
 		// Reads N bits from the given pointer, returns null reference if alias failure occurs.
 		// - Will output the mask of bits contained in the state into contains if it does not fail.
 		//
-		expression::reference read( const pointer& ptr, bitcnt_t size, const il_const_iterator& reference_iterator = symbolic::free_form_iterator, uint64_t* contains = nullptr, fn_calc_distance distance = bit_distance ) const;
+		expression::reference read( const pointer& ptr, bitcnt_t size, const il_const_iterator& reference_iterator = symbolic::free_form_iterator, uint64_t* contains = nullptr, fn_calc_distance distance = {} ) const;
 
 		// Writes the given value to the pointer, returns null reference if alias failure occurs.
 		//
-		optional_reference<expression::reference> write( const pointer& ptr, deferred_value<expression::reference> value, bitcnt_t size, fn_calc_distance distance = bit_distance );
-		optional_reference<expression::reference> write( const pointer& ptr, expression::reference value, fn_calc_distance distance = bit_distance ) { return write( ptr, value, value.size(), std::move( distance ) ); }
+		optional_reference<expression::reference> write( const pointer& ptr, deferred_value<expression::reference> value, bitcnt_t size, fn_calc_distance distance = {} );
+		optional_reference<expression::reference> write( const pointer& ptr, expression::reference value, fn_calc_distance distance = {} ) { return write( ptr, value, value.size(), std::move( distance ) ); }
+
+		// Inserts or removes the entry from the index, reserved for internal use.
+		//
+		void index_insert( store_type::iterator it, uint64_t order );
+		void index_erase( store_type::iterator it );
+
+		// Allocates an order for an entry to be inserted before the given position, reserved for internal use.
+		//
+		uint64_t allocate_order( store_type::iterator it );
 	};
 };
\ No newline at end of file
@@ -82,6 +82,21 @@ namespace vtil::symbolic
 		}
 	}
 
+	// Checks whether the value ranges of the two pointers are far enough apart that no access 
+	// made through them can overlap, regardless of the access size.
+	//
+	static bool is_disjoint_range( const expression::reference& a, const expression::reference& b )
+	{
+		static constexpr uint64_t max_access_size = 64 / 8;
+		if ( !a || !b || a->size() != 64 || b->size() != 64 )
+			return false;
+
+		const auto& ra = a->range;
+		const auto& rb = b->range;
+		return ( ra.umax <= UINT64_MAX - max_access_size && ( ra.umax + max_access_size ) <= rb.umin ) ||
+			   ( rb.umax <= UINT64_MAX - max_access_size && ( rb.umax + max_access_size ) <= ra.umin );
+	}
+
 	// Construct from symbolic expression.
 	//
 	pointer::pointer( const expression::reference& _base ) : base( _base.simplify() )
@@ -141,6 +156,8 @@ namespace vtil::symbolic
 	//
 	bool pointer::can_overlap( const pointer& o ) const
 	{
+		if ( is_disjoint_range( base, o.base ) )
+			return false;
 		return ( ( flags & o.flags ) == flags   ) ||
 			   ( ( flags & o.flags ) == o.flags );
 	}
@@ -149,6 +166,8 @@ namespace vtil::symbolic
 	//
 	bool pointer::can_overlap_s( const pointer& o ) const
 	{
+		if ( is_disjoint_range( base, o.base ) )
+			return false;
 		return ( ( flags & o.flags ) == flags   ) &&
 			   ( ( flags & o.flags ) == o.flags );
 	}
@@ -87,7 +87,8 @@ namespace vtil::symbolic
 		// Checks whether the two pointers can overlap in terms of real destination, 
 		// note that it will consider [rsp+C1] and [rsp+C2] "overlapping" so you will
 		// need to check the displacement with the variable sizes considered if you 
-		// are checking "is overlapping" instead.
+		// are checking "is overlapping" instead. Pointers whose value ranges are
+		// disjoint are never considered overlapping.
 		//
 		bool can_overlap( const pointer& o ) const;
 		
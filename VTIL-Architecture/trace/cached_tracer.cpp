@@ -55,11 +55,35 @@ namespace vtil
 			return result;
 		}
 
+		// Lock the shard the block belongs to, count the lookup as contended if it
+		// could not be acquired without blocking.
+		//
+		const basic_block* blk = lookup.at.block;
+		epoch_t epoch = blk->epoch;
+		cache_shard& shard = shard_of( blk );
+		shard.lookups.fetch_add( 1, std::memory_order::relaxed );
+		std::shared_lock lock{ shard.mtx, std::try_to_lock };
+		if ( !lock.owns_lock() )
+		{
+			shard.contended.fetch_add( 1, std::memory_order::relaxed );
+			lock.lock();
+		}
+
+		// Find the entries of the block, ignore them if the block was modified since.
+		//
+		const cache_type* entries = nullptr;
+		if ( auto bit = shard.blocks.find( blk ); bit != shard.blocks.end() )
+		{
+			if ( bit->second.epoch == epoch )
+				entries = &bit->second.entries;
+			else
+				shard.stale.fetch_add( 1, std::memory_order::relaxed );
+		}
+
 		// Try lookup the exact variable in the map in a fast manner.
 		//
-		std::shared_lock lock{ mtx };
-		auto it = cache.find( lookup );
-		if ( it != cache.end() )
+		auto it = entries ? entries->find( lookup ) : cache_type::const_iterator{};
+		if ( entries && it != entries->end() )
 		{
 			// If recursive flag is set, fix the expression:
 			//
@@ -88,7 +112,8 @@ namespace vtil
 				return result;
 			}*/
 
-			symbolic::expression::reference& result = it->second;
+			const symbolic::expression::reference& result = it->second;
+			shard.hits.fetch_add( 1, std::memory_order::relaxed );
 #if VTIL_OPT_TRACE_VERBOSE
 			// Log result.
 			//
@@ -130,27 +155,44 @@ namespace vtil
 		};
 
 
-		// Search the map, if we find a matching entry shrink and use as the result.
+		// Search the entries of the block, if we find a matching entry shrink and use as the result.
 		//
 		symbolic::expression::reference result;
-		it = std::find_if( cache.begin(), cache.end(), predicate );
-		if ( it != cache.end() )
+		if ( entries && ( it = std::find_if( entries->begin(), entries->end(), predicate ) ) != entries->end() )
 		{
 			result = it->second;
 			lock = {};
 			result.resize( lookup.bit_count() );
+			shard.partial_hits.fetch_add( 1, std::memory_order::relaxed );
 		}
 		else
 		{
 			lock = {};
 			result = tracer::trace( lookup );
+			shard.misses.fetch_add( 1, std::memory_order::relaxed );
 		}
 
 		// Insert a cache entry for the exact variable we're looking up and return.
 		//
 		{
-			std::unique_lock ulock{ mtx };
-			cache.emplace( lookup, result );
+			std::unique_lock ulock{ shard.mtx, std::try_to_lock };
+			if ( !ulock.owns_lock() )
+			{
+				shard.contended.fetch_add( 1, std::memory_order::relaxed );
+				ulock.lock();
+			}
+
+			// Discard the entries of the block if they are stale, skip the insertion if 
+			// the block was modified while tracing.
+			//
+			auto& bcache = shard.blocks[ blk ];
+			if ( bcache.epoch != blk->epoch )
+			{
+				bcache.entries.clear();
+				bcache.epoch = blk->epoch;
+			}
+			if ( bcache.epoch == epoch )
+				bcache.entries.emplace( lookup, result );
 		}
 
 	#if VTIL_OPT_TRACE_VERBOSE
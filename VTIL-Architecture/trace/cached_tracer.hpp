@@ -30,11 +30,60 @@
 #include <vtil/common>
 #include <unordered_map>
 #include <shared_mutex>
+#include <mutex>
+#include <vector>
+#include <array>
 #include "tracer.hpp"
 #include "../symex/variable.hpp"
 
+// [Configuration]
+// Determine the number of shards the tracer cache is split into, each with its own lock.
+//
+#ifndef VTIL_TRACER_CACHE_SHARDS
+    #define VTIL_TRACER_CACHE_SHARDS 32
+#endif
+
 namespace vtil
 {
+    // Statistics of a tracer cache.
+    //
+    struct cached_tracer_stats
+    {
+        // Number of lookups made and the way they were resolved, partial hits are 
+        // served by resizing the entry of a larger variable at the same position.
+        //
+        size_t lookups = 0;
+        size_t hits = 0;
+        size_t partial_hits = 0;
+        size_t misses = 0;
+
+        // Number of times the entries of a block were discarded since the block was 
+        // modified after they were traced.
+        //
+        size_t stale = 0;
+
+        // Number of times a shard lock could not be acquired without blocking.
+        //
+        size_t contended = 0;
+
+        // Current number of entries and blocks they belong to.
+        //
+        size_t entries = 0;
+        size_t blocks = 0;
+
+        // Ratio of lookups resolved without tracing.
+        //
+        double hit_ratio() const { return lookups ? double( hits + partial_hits ) / lookups : 0.0; }
+
+        // Conversion to human-readable format.
+        //
+        std::string to_string() const
+        {
+            return format::str( "lookups=%llu hits=%llu partial=%llu misses=%llu stale=%llu contended=%llu entries=%llu blocks=%llu hit-ratio=%.2lf%%",
+                                lookups, hits, partial_hits, misses, stale, contended, entries, blocks, hit_ratio() * 100 );
+        }
+    };
+
     // Tracing is extremely costy and adding a simple cache reduces the cost 
     // by ~100x fold, so this class creates a local cache that gets looked 
     // up before the actual trace operation is executed.
@@ -46,43 +95,175 @@ namespace vtil
         using cache_type =  std::unordered_map<symbolic::variable, symbolic::expression::reference>;
         using cache_entry = cache_type::value_type;
 
-        // Declare the lookup map for the cache mapping each variable to the
-        // result of the primitive traver.
+        // Entries of a single block, tagged with the epoch of the block at the time 
+        // they were traced. If the block is modified afterwards the entries are stale 
+        // and are discarded on the next lookup.
         //
-        mutable cache_type cache;
-        
-        // Locks the cache.
+        struct block_cache
+        {
+            epoch_t epoch = invalid_epoch;
+            cache_type entries;
+        };
+
+        // The cache is split into shards each with its own lock, blocks are distributed 
+        // by their address so that every entry a lookup can be served from is in the 
+        // same shard as the lookup itself.
         //
-        mutable relaxed<std::shared_mutex> mtx;
+        struct alignas( 64 ) cache_shard
+        {
+            // Per-block lookup maps mapping each variable to the result of the primitive 
+            // tracer and the lock protecting them.
+            //
+            std::unordered_map<const basic_block*, block_cache> blocks;
+            relaxed<std::shared_mutex> mtx;
+
+            // Statistics.
+            //
+            relaxed_atomic<size_t> lookups = 0;
+            relaxed_atomic<size_t> hits = 0;
+            relaxed_atomic<size_t> partial_hits = 0;
+            relaxed_atomic<size_t> misses = 0;
+            relaxed_atomic<size_t> stale = 0;
+            relaxed_atomic<size_t> contended = 0;
+        };
+        mutable std::array<cache_shard, VTIL_TRACER_CACHE_SHARDS> shards;
 
         // Hooks default tracer and does a cache lookup before invokation.
         //
         symbolic::expression::reference trace( const symbolic::variable& lookup ) override;
 
+        // Every live tracer is registered so that the entries of a block can be evicted
+        // from all of them before the block is deleted.
+        //
+        inline static std::mutex registry_mutex;
+        inline static std::vector<cached_tracer*> registry;
+        void attach() { std::lock_guard _g{ registry_mutex }; registry.push_back( this ); }
+        void detach() { std::lock_guard _g{ registry_mutex }; std::erase( registry, this ); }
+
         // Default construtor.
         //
-        cached_tracer() {}
+        cached_tracer() { attach(); }
 
-        // Default copy/move.
+        // Default copy/move, registration is not affected by assignment.
         //
-        cached_tracer( cached_tracer&& o ) = default;
-        cached_tracer( const cached_tracer& o ) = default;
+        cached_tracer( cached_tracer&& o ) : tracer( std::move( o ) ), shards( std::move( o.shards ) ) { attach(); }
+        cached_tracer( const cached_tracer& o ) : tracer( o ), shards( o.shards ) { attach(); }
         cached_tracer& operator=( cached_tracer&& o ) = default;
         cached_tracer& operator=( const cached_tracer& o ) = default;
-        
-        // Flushes the cache.
+
+        // Destructor unregisters the tracer.
+        //
+        ~cached_tracer() { detach(); }
+
+        // Gets the shard the block belongs to.
+        //
+        cache_shard& shard_of( const basic_block* blk ) const
+        {
+            return shards[ make_hash( blk ).as64() % VTIL_TRACER_CACHE_SHARDS ];
+        }
+
+        // Inserts or replaces the cache entry of the variable, tagged with the current 
+        // epoch of the block it belongs to.
+        //
+        void insert( const symbolic::variable& var, const symbolic::expression::reference& exp )
+        {
+            auto& shard = shard_of( var.at.block );
+            std::unique_lock lock{ shard.mtx };
+            auto& bcache = shard.blocks[ var.at.block ];
+            if ( bcache.epoch != var.at.block->epoch )
+            {
+                bcache.entries.clear();
+                bcache.epoch = var.at.block->epoch;
+            }
+            bcache.entries.insert_or_assign( var, exp );
+        }
+
+        // Enumerates each entry in the cache that is not stale with the shard locked for 
+        // reading, the enumerator should not call back into the tracer.
+        // - Blocks are evicted before they are deleted so each block listed is still alive.
+        //
+        template<typename T>
+        void enumerate( T&& fn ) const
+        {
+            for ( auto& shard : shards )
+            {
+                std::shared_lock lock{ shard.mtx };
+                for ( auto& [blk, bcache] : shard.blocks )
+                {
+                    if ( bcache.epoch != blk->epoch )
+                        continue;
+                    for ( auto& [var, exp] : bcache.entries )
+                        if ( enumerator::invoke( fn, var, exp ).should_break )
+                            return;
+                }
+            }
+        }
+
+        // Returns the number of entries in the cache, including the stale ones.
         //
-        void flush() { cache.clear(); }
-        void flush( basic_block* blk )
+        size_t size() const
         {
-            std::unique_lock lock{ mtx };
-            for ( auto it = cache.begin(); it != cache.end(); )
+            size_t n = 0;
+            for ( auto& shard : shards )
             {
-                if ( it->first.at.block == blk )
-                    it = cache.erase( it );
-                else
-                    it++;
+                std::shared_lock lock{ shard.mtx };
+                for ( auto& [blk, bcache] : shard.blocks )
+                    n += bcache.entries.size();
             }
+            return n;
+        }
+
+        // Returns a snapshot of the cache statistics or resets the counters.
+        //
+        cached_tracer_stats get_stats() const
+        {
+            cached_tracer_stats stats = {};
+            for ( auto& shard : shards )
+            {
+                std::shared_lock lock{ shard.mtx };
+                stats.lookups += shard.lookups;
+                stats.hits += shard.hits;
+                stats.partial_hits += shard.partial_hits;
+                stats.misses += shard.misses;
+                stats.stale += shard.stale;
+                stats.contended += shard.contended;
+                stats.blocks += shard.blocks.size();
+                for ( auto& [blk, bcache] : shard.blocks )
+                    stats.entries += bcache.entries.size();
+            }
+            return stats;
+        }
+        void reset_stats()
+        {
+            for ( auto& shard : shards )
+                shard.lookups = shard.hits = shard.partial_hits = shard.misses = shard.stale = shard.contended = 0;
+        }
+
+        // Flushes the cache, either entirely or only the entries of the given block.
+        //
+        void flush() 
+        {
+            for ( auto& shard : shards )
+            {
+                std::unique_lock lock{ shard.mtx };
+                shard.blocks.clear();
+            }
+        }
+        void flush( const basic_block* blk )
+        {
+            auto& shard = shard_of( blk );
+            std::unique_lock lock{ shard.mtx };
+            shard.blocks.erase( blk );
+        }
+
+        // Flushes the entries of the given block from every live tracer, invoked by the
+        // routine before the block is deleted.
+        //
+        static void evict( const basic_block* blk )
+        {
+            std::lock_guard _g{ registry_mutex };
+            for ( cached_tracer* tracer : registry )
+                tracer->flush( blk );
         }
 	};
 };
\ No newline at end of file
@@ -36,6 +36,11 @@ namespace vtil
 	//
 	using path_map_t = std::map<std::pair<const basic_block*, const basic_block*>, int>;
 
+	// Set on tasks tracing a path on behalf of a parallel ::rtrace, part of the task 
+	// context so that unrelated work run by a waiting thread does not observe it.
+	//
+	static task_context_local( bool ) parallel_path_trace = false;
+
 	// Forward defs.
 	//
 	static symbolic::expression::reference rtrace_primitive( const symbolic::variable& lookup, tracer* tracer, path_map_t& path_map, const basic_block* target );
@@ -322,31 +327,12 @@ namespace vtil
 				for ( auto& it : it_list )
 					potential_loop |= it.block == lookup.at.block;*/
 
-				// Enumerate each path:
+				// Declare the path tracer, propagates each variable onto to the destination block with 
+				// the given path history, returns false if the path is not taken or if propagation 
+				// failed entirely.
 				//
-				lookup.at.enum_paths( false, [ & ] ( const il_const_iterator& it )
+				auto take_path = [ & ] ( const il_const_iterator& it, path_map_t& path_map, symbolic::expression::reference& exp )
 				{
-					// Skip if it does not reach target.
-					//
-#if _DEBUG
-					if ( !target->owner->has_path( it.block, target ) )
-					{
-						warning( "Iterator %s has no path to %s but is still being considered in backpropagation.",
-							   it, target->begin() );
-					}
-#endif
-
-					// Increment path count.
-					//
-					if ( ++count == 0 )
-					{
-#if VTIL_OPT_TRACE_VERBOSE
-						// Log recursive tracing of the expression.
-						//
-						log<CON_GRN>( "Base case: %s\n", result );
-#endif
-					}
-
 					// If we've taken this path more than twice, skip it.
 					//
 					if ( potential_loop )
@@ -359,7 +345,7 @@ namespace vtil
 							//
 							log<CON_CYN>( "Path [%llx->%llx] is not taken as it's n-looping.\n", lookup.at.block->entry_vip, it.block->entry_vip );
 #endif
-							return enumerator::ocontinue;
+							return false;
 						}
 						++counter;
 					}
@@ -371,13 +357,17 @@ namespace vtil
 #endif
 					// Propagate each variable onto to the destination block, if total fail, skip path.
 					//
-					symbolic::expression::reference exp = default_result;
+					exp = default_result;
 					bool total_fail = propagate( exp, it, tracer, &path_map, target );
 					if ( potential_loop )
 						path_map[ { lookup.at.block, it.block } ]--;
-					if ( total_fail )
-						return enumerator::ocontinue;
+					return !total_fail;
+				};
 
+				// Declare the path merger, returns false if the tracer should halt.
+				//
+				auto merge_path = [ & ] ( const symbolic::expression::reference& exp )
+				{
 #if VTIL_OPT_TRACE_VERBOSE
 					// Log result.
 					//
@@ -418,10 +408,97 @@ namespace vtil
 								}
 							}, true, false );
 						}
-						return enumerator::obreak;
+						return false;
 					}
-					return enumerator::ocontinue;
+					return true;
+				};
+
+				// Enumerate each path:
+				//
+				std::vector<il_const_iterator> paths;
+				lookup.at.enum_paths( false, [ & ] ( const il_const_iterator& it )
+				{
+					// Skip if it does not reach target.
+					//
+#if _DEBUG
+					if ( !target->owner->has_path( it.block, target ) )
+					{
+						warning( "Iterator %s has no path to %s but is still being considered in backpropagation.",
+							   it, target->begin() );
+					}
+#endif
+					paths.emplace_back( it );
 				} );
+
+				// If we should trace the paths in parallel:
+				//
+				if ( tracer->parallel_paths && !*parallel_path_trace && paths.size() >= VTIL_OPT_TRACE_PARALLEL_MIN_PATHS )
+				{
+					// Trace each path on the task pool with a copy of the current path history, 
+					// merge points reached by these are traced serially.
+					//
+					struct path_entry
+					{
+						il_const_iterator it;
+						path_map_t path_map;
+						symbolic::expression::reference exp = {};
+						bool taken = false;
+					};
+					std::vector<path_entry> entries;
+					entries.reserve( paths.size() );
+					for ( auto& it : paths )
+						entries.push_back( { it, path_map } );
+					bool history_empty = path_map.empty();
+
+					transform_parallel( entries, [ & ] ( path_entry& entry )
+					{
+						bool parallel_prev = std::exchange( *parallel_path_trace, true );
+						bool recursive_flag_prev = std::exchange( *vtil::tracer::recursive_flag, true );
+						entry.taken = take_path( entry.it, entry.path_map, entry.exp );
+						*vtil::tracer::recursive_flag = recursive_flag_prev;
+						*parallel_path_trace = parallel_prev;
+					} );
+
+					// Merge the results in the original order. Path counters are restored after 
+					// each path so the history each path was traced with only differs from the 
+					// serial order by the keys left by the previous paths, which is observable 
+					// only if the history would no longer be empty, in which case the path is 
+					// traced again with the actual history.
+					//
+					for ( auto& entry : entries )
+					{
+						++count;
+						if ( !potential_loop && history_empty && !path_map.empty() )
+							entry.taken = take_path( entry.it, path_map, entry.exp );
+						else
+							path_map.insert( entry.path_map.begin(), entry.path_map.end() );
+
+						if ( entry.taken && !merge_path( entry.exp ) )
+							break;
+					}
+				}
+				else
+				{
+					for ( auto& it : paths )
+					{
+						// Increment path count.
+						//
+						if ( ++count == 0 )
+						{
+#if VTIL_OPT_TRACE_VERBOSE
+							// Log recursive tracing of the expression.
+							//
+							log<CON_GRN>( "Base case: %s\n", result );
+#endif
+						}
+
+						// Take the path and merge the result.
+						//
+						symbolic::expression::reference exp;
+						if ( take_path( it, path_map, exp ) && !merge_path( exp ) )
+							break;
+					}
+				}
 			}
 
 			// If result is null, use default result instead if the call will reach the user,
@@ -468,7 +545,7 @@ namespace vtil
 
 			// If variable is being written to, break.
 			//
-			if ( details = lookup.written_by( it, this, recursive_flag ) )
+			if ( details = lookup.written_by( it, this, *recursive_flag ) )
 			{
 				// If unknown access, return unknown.
 				//
@@ -539,10 +616,10 @@ namespace vtil
 	//
 	symbolic::expression::reference tracer::rtrace( const symbolic::variable& lookup )
 	{
-		bool recursive_flag_prev = std::exchange( recursive_flag, true );
+		bool recursive_flag_prev = std::exchange( *recursive_flag, true );
 		path_map_t path_map = {};
 		auto exp = rtrace_primitive( lookup, this, path_map, lookup.at.block );
-		recursive_flag = recursive_flag_prev;
+		*recursive_flag = recursive_flag_prev;
 		return exp;
 	}
 	
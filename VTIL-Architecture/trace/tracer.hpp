@@ -36,13 +36,30 @@
 	#define VTIL_OPT_TRACE_VERBOSE 0
 #endif
 
+// [Configuration]
+// Determine whether cross-block tracing should trace the predecessors of a merge point in 
+// parallel by default and the minimum number of predecessors for it to do so.
+//
+#ifndef VTIL_OPT_TRACE_PARALLEL_PATHS
+	#define VTIL_OPT_TRACE_PARALLEL_PATHS false
+#endif
+#ifndef VTIL_OPT_TRACE_PARALLEL_MIN_PATHS
+	#define VTIL_OPT_TRACE_PARALLEL_MIN_PATHS 4
+#endif
+
 namespace vtil
 {
 	// Basic tracer implementation.
 	//
 	struct tracer
 	{
-		inline static thread_local bool recursive_flag = false;
+		inline static task_context_local( bool ) recursive_flag = false;
+
+		// Whether or not ::rtrace should trace the paths of the first merge point with enough 
+		// predecessors in parallel on the task pool, results are identical to the serial trace 
+		// as long as ::trace is deterministic.
+		//
+		bool parallel_paths = VTIL_OPT_TRACE_PARALLEL_PATHS;
 
 		// Traces a variable across the basic block it belongs to and generates a symbolic expression 
 		// that describes it's value at the bound point. The provided variable should not contain a 
@@ -0,0 +1,497 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of VTIL Project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software 
+//    without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include <vtil/vtil>
+#include <vtil/compiler>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <set>
+#include <cmath>
+
+// [Configuration]
+// Determine the default path the sample routines are loaded from.
+//
+#ifndef VTIL_BENCH_CORPUS
+	#define VTIL_BENCH_CORPUS "Sample Routines"
+#endif
+
+using namespace vtil;
+
+// Command line options.
+//
+struct bench_options
+{
+	size_t iterations = 10;
+	size_t warmup = 1;
+	size_t synthetic_blocks = 16;
+	size_t synthetic_size = 64;
+	size_t expression_count = 256;
+	size_t expression_depth = 6;
+	size_t mba_count = 64;
+	uint64_t seed = 0x5eed;
+	bool shared_cache = false;
+	std::filesystem::path corpus = VTIL_BENCH_CORPUS;
+	std::filesystem::path output = "vtil-bench.json";
+	std::string filter;
+};
+
+// Statistics of a single benchmark.
+//
+struct bench_result
+{
+	std::string name;
+	size_t iterations;
+	timeunit_t min;
+	timeunit_t median;
+	timeunit_t p90;
+	timeunit_t p99;
+	timeunit_t max;
+	timeunit_t mean;
+};
+
+// Calculates the statistics of the samples given.
+//
+static bench_result summarize( std::string name, std::vector<timeunit_t> samples )
+{
+	std::sort( samples.begin(), samples.end() );
+	auto percentile = [ & ] ( double p )
+	{
+		size_t rank = ( size_t ) std::ceil( p * samples.size() );
+		return samples[ std::clamp<size_t>( rank, 1, samples.size() ) - 1 ];
+	};
+
+	timeunit_t total = {};
+	for ( auto& sample : samples )
+		total += sample;
+
+	return {
+		std::move( name ),
+		samples.size(),
+		samples.front(),
+		percentile( 0.50 ),
+		percentile( 0.90 ),
+		percentile( 0.99 ),
+		samples.back(),
+		total / samples.size()
+	};
+}
+
+// Escapes the string for use as a JSON string literal.
+//
+static std::string json_escape( const std::string& str )
+{
+	std::string result;
+	result.reserve( str.size() );
+	for ( char c : str )
+	{
+		switch ( c )
+		{
+			case '"':  result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			case '\r': result += "\\r"; break;
+			case '\t': result += "\\t"; break;
+			default:
+				if ( uint8_t( c ) < 0x20 ) result += format::str( "\\u%04x", uint8_t( c ) );
+				else                       result += c;
+				break;
+		}
+	}
+	return result;
+}
+
+// Benchmark driver, setup is invoked before every sample and is not timed.
+//
+struct bench_runner
+{
+	const bench_options& options;
+	std::vector<bench_result> results;
+
+	template<typename S, typename F>
+	void run( const std::string& name, S&& setup, F&& body )
+	{
+		if ( !options.filter.empty() && name.find( options.filter ) == std::string::npos )
+			return;
+
+		std::vector<timeunit_t> samples;
+		for ( size_t n = 0; n != ( options.warmup + options.iterations ); n++ )
+		{
+			auto state = setup();
+			timeunit_t time = profile( [ & ] () { body( state ); } );
+			if ( n >= options.warmup )
+				samples.emplace_back( time );
+		}
+
+		auto& result = results.emplace_back( summarize( name, std::move( samples ) ) );
+		logger::log( "%-64s median %-12s p90 %-12s p99 %-12s\n", result.name, result.median, result.p90, result.p99 );
+	}
+
+	// Writes the results in JSON format.
+	//
+	void write_json( std::ostream& out ) const
+	{
+		out << "{\n";
+		out << format::str( "  \"iterations\": %llu,\n", options.iterations );
+		out << format::str( "  \"warmup\": %llu,\n", options.warmup );
+		out << format::str( "  \"threads\": %llu,\n", task::thread_pool::global().size() );
+		out << "  \"unit\": \"ns\",\n";
+		out << "  \"results\": [";
+		for ( auto [result, idx] : zip( results, iindices ) )
+		{
+			out << ( idx ? ",\n" : "\n" );
+			out << format::str( "    { \"name\": \"%s\", \"iterations\": %llu, \"min\": %lld, \"median\": %lld, \"p90\": %lld, \"p99\": %lld, \"max\": %lld, \"mean\": %lld }",
+								json_escape( result.name ), result.iterations,
+								result.min.count(), result.median.count(), result.p90.count(),
+								result.p99.count(), result.max.count(), result.mean.count() );
+		}
+		out << "\n  ]\n}\n";
+	}
+};
+
+// Generates a synthetic routine with a chain of blocks doing random arithmetic on a set of 
+// virtual registers and the stack, occasionally branching over the next block.
+//
+static routine* make_synthetic_routine( size_t block_count, size_t block_size, uint64_t seed )
+{
+	std::mt19937_64 rng{ seed };
+	auto vip_of = [ ] ( size_t idx ) { return vip_t( 0x1000 * ( idx + 1 ) ); };
+	auto reg_of = [ ] ( size_t idx ) { return register_desc{ register_virtual, idx, 64 }; };
+
+	basic_block* entry = basic_block::begin( vip_of( 0 ) );
+	routine* rtn = entry->owner;
+	for ( size_t idx = 0; idx != block_count; idx++ )
+	{
+		basic_block* blk = rtn->get_block( vip_of( idx ) );
+		for ( size_t n = 0; n != block_size; n++ )
+		{
+			auto dst = reg_of( rng() % 8 );
+			auto src = reg_of( rng() % 8 );
+			int64_t offset = -8 * int64_t( 1 + rng() % 8 );
+			switch ( rng() % 8 )
+			{
+				case 0: blk->mov( dst, rng() ); break;
+				case 1: blk->add( dst, src ); break;
+				case 2: blk->sub( dst, src ); break;
+				case 3: blk->bxor( dst, src ); break;
+				case 4: blk->band( dst, rng() ); break;
+				case 5: blk->bshl( dst, uint8_t( rng() % 64 ) ); break;
+				case 6: blk->str( REG_SP, offset, src ); break;
+				case 7: blk->ldd( dst, REG_SP, offset ); break;
+			}
+		}
+
+		if ( ( idx + 1 ) == block_count )
+		{
+			blk->vexit( 0ull );
+		}
+		else if ( ( idx + 2 ) < block_count && !( rng() % 3 ) )
+		{
+			auto cond = blk->tmp( 1 );
+			blk->tl( cond, reg_of( rng() % 8 ), reg_of( rng() % 8 ) );
+			blk->js( cond, vip_of( idx + 1 ), vip_of( idx + 2 ) );
+			blk->fork( vip_of( idx + 1 ) );
+			blk->fork( vip_of( idx + 2 ) );
+		}
+		else
+		{
+			blk->jmp( vip_of( idx + 1 ) );
+			blk->fork( vip_of( idx + 1 ) );
+		}
+	}
+	return rtn;
+}
+
+// Generates random expression trees over a few variables for the simplifier.
+//
+static std::vector<symbolic::expression::reference> make_synthetic_expressions( size_t count, size_t depth, uint64_t seed )
+{
+	using namespace symbolic;
+	std::mt19937_64 rng{ seed };
+
+	static constexpr math::operator_id operators[] = {
+		math::operator_id::add,         math::operator_id::subtract,   math::operator_id::multiply,
+		math::operator_id::bitwise_and, math::operator_id::bitwise_or, math::operator_id::bitwise_xor,
+	};
+	auto rec = [ & ] ( auto&& self, size_t level ) -> expression::reference
+	{
+		if ( !level || !( rng() % 4 ) )
+		{
+			if ( rng() % 3 )
+				return expression{ unique_identifier{ format::str( "x%llu", rng() % 6 ) }, 64 }.make_lazy();
+			return expression{ rng() % 0x100, 64 }.make_lazy();
+		}
+		if ( !( rng() % 8 ) )
+			return expression{ math::operator_id::bitwise_not, self( self, level - 1 ) };
+		auto lhs = self( self, level - 1 );
+		auto rhs = self( self, level - 1 );
+		return expression{ lhs, operators[ rng() % std::size( operators ) ], rhs };
+	};
+
+	std::vector<expression::reference> result;
+	for ( size_t n = 0; n != count; n++ )
+		result.emplace_back( rec( rec, depth ) );
+	return result;
+}
+
+// Generates mixed boolean-arithmetic expressions by rewriting random operations over a few 
+// variables with their well known MBA equivalents, nested once or twice.
+//
+static std::vector<symbolic::expression::reference> make_mba_expressions( size_t count, uint64_t seed )
+{
+	using namespace symbolic;
+	std::mt19937_64 rng{ seed };
+
+	auto rec = [ & ] ( auto&& self, size_t level ) -> expression::reference
+	{
+		if ( !level )
+			return expression{ unique_identifier{ format::str( "x%llu", rng() % 4 ) }, 64 }.make_lazy();
+
+		auto a = self( self, level - 1 );
+		auto b = self( self, level - 1 );
+		auto two = expression{ 2ull, 64 }.make_lazy();
+		switch ( rng() % 6 )
+		{
+			case 0:  return ( a ^ b ) + two * ( a & b );   // a + b
+			case 1:  return ( a | b ) + ( a & b );         // a + b
+			case 2:  return ( a | b ) - ( a & b );         // a ^ b
+			case 3:  return ( a ^ b ) - two * ( ~a & b );  // a - b
+			case 4:  return ( a & ~b ) + b;                // a | b
+			default: return ( a + b ) - ( a | b );         // a & b
+		}
+	};
+
+	std::vector<expression::reference> result;
+	for ( size_t n = 0; n != count; n++ )
+		result.emplace_back( rec( rec, 1 + rng() % 2 ) );
+	return result;
+}
+
+// Benchmarks a single pass on the routine.
+//
+template<typename T>
+static void bench_pass( bench_runner& runner, const std::string& name, const routine* rtn )
+{
+	runner.run( "pass/" + T{}.name() + "/" + name, 
+		[ & ] () { return std::unique_ptr<routine>( rtn->clone() ); }, 
+		[ ] ( auto& copy ) { T{}( copy.get() ); } );
+}
+template<typename... Tx>
+static void bench_passes( bench_runner& runner, const std::string& name, const routine* rtn )
+{
+	( bench_pass<Tx>( runner, name, rtn ), ... );
+}
+
+// Benchmarks every workload on the routine given.
+//
+static void bench_routine( bench_runner& runner, const std::string& name, const routine* rtn )
+{
+	// Whole optimizer.
+	//
+	runner.run( "apply_all/" + name,
+		[ & ] () { return std::unique_ptr<routine>( rtn->clone() ); },
+		[ ] ( auto& copy ) { optimizer::apply_all( copy.get() ); } );
+
+	// Each individual pass.
+	//
+	bench_passes<
+		optimizer::stack_pinning_pass,
+		optimizer::istack_ref_substitution_pass,
+		optimizer::bblock_extension_pass,
+		optimizer::stack_propagation_pass,
+		optimizer::dead_code_elimination_pass,
+		optimizer::mov_propagation_pass,
+		optimizer::register_renaming_pass,
+		optimizer::symbolic_rewrite_pass<true>,
+		optimizer::branch_correction_pass
+	>( runner, name, rtn );
+
+	// Tracing every register used by each block from the end of the block with a cold cache, 
+	// cross-block tracing is limited to the exits since the number of paths grows quickly.
+	//
+	std::vector<symbolic::variable> variables;
+	std::vector<symbolic::variable> exit_variables;
+	for ( auto& [vip, blk] : rtn->explored_blocks )
+	{
+		std::set<register_desc> registers;
+		for ( auto& ins : *blk )
+			for ( auto& op : ins.operands )
+				if ( op.is_register() && !op.reg().is_stack_pointer() )
+					registers.insert( op.reg() );
+		for ( auto& reg : registers )
+		{
+			auto& var = variables.emplace_back( std::prev( make_const( blk )->end() ), reg );
+			if ( blk->next.empty() )
+				exit_variables.emplace_back( var );
+		}
+	}
+	cached_tracer_stats trace_stats = {};
+	runner.run( "cached_tracer::trace/" + name,
+		[ ] () { return std::make_unique<cached_tracer>(); },
+		[ & ] ( auto& tracer ) { for ( auto& var : variables ) tracer->trace( var ); trace_stats = tracer->get_stats(); } );
+	logger::log( "Tracer cache for %s: %s\n", name, trace_stats.to_string() );
+	runner.run( "cached_tracer::rtrace/" + name,
+		[ ] () { return std::make_unique<cached_tracer>(); },
+		[ & ] ( auto& tracer ) { for ( auto& var : exit_variables ) tracer->rtrace( var ); } );
+	runner.run( "cached_tracer::rtrace_parallel/" + name,
+		[ ] () { auto tracer = std::make_unique<cached_tracer>(); tracer->parallel_paths = true; return tracer; },
+		[ & ] ( auto& tracer ) { for ( auto& var : exit_variables ) tracer->rtrace( var ); } );
+
+	// Serialization round-trip.
+	//
+	runner.run( "serialization/" + name,
+		[ ] () { return 0; },
+		[ & ] ( auto& ) 
+		{
+			std::stringstream ss;
+			serialize( ss, rtn );
+			routine* copy = nullptr;
+			deserialize( ss, copy );
+			delete copy;
+		} );
+}
+
+int main( int argc, char** argv )
+{
+	// Parse the command line.
+	//
+	bench_options options;
+	for ( int i = 1; i < argc; i++ )
+	{
+		std::string_view arg = argv[ i ];
+		const char* value = ( i + 1 ) < argc ? argv[ i + 1 ] : nullptr;
+		if ( !value )
+		{
+			logger::warning( "Missing value for option %s.", arg );
+			return 1;
+		}
+		i++;
+
+		if ( arg == "--iterations" )            options.iterations = std::stoull( value );
+		else if ( arg == "--warmup" )           options.warmup = std::stoull( value );
+		else if ( arg == "--synthetic-blocks" ) options.synthetic_blocks = std::stoull( value );
+		else if ( arg == "--synthetic-size" )   options.synthetic_size = std::stoull( value );
+		else if ( arg == "--expressions" )      options.expression_count = std::stoull( value );
+		else if ( arg == "--expression-depth" ) options.expression_depth = std::stoull( value );
+		else if ( arg == "--mba-expressions" )  options.mba_count = std::stoull( value );
+		else if ( arg == "--seed" )             options.seed = std::stoull( value, nullptr, 0 );
+		else if ( arg == "--shared-cache" )     options.shared_cache = std::stoull( value ) != 0;
+		else if ( arg == "--corpus" )           options.corpus = value;
+		else if ( arg == "--output" )           options.output = value;
+		else if ( arg == "--filter" )           options.filter = value;
+		else
+		{
+			logger::warning( "Unknown option %s.", arg );
+			return 1;
+		}
+	}
+	if ( !options.iterations )
+	{
+		logger::warning( "Iteration count cannot be zero." );
+		return 1;
+	}
+	bench_runner runner = { options, {} };
+	symbolic::set_shared_simplifier_cache( options.shared_cache );
+
+	// Benchmark the sample routines.
+	//
+	if ( std::filesystem::exists( options.corpus ) )
+	{
+		std::vector<std::filesystem::path> paths;
+		for ( auto& entry : std::filesystem::directory_iterator( options.corpus ) )
+			if ( entry.path().extension() == ".vtil" )
+				paths.emplace_back( entry.path() );
+		std::sort( paths.begin(), paths.end() );
+
+		for ( auto& path : paths )
+		{
+			std::unique_ptr<routine> rtn{ load_routine( path ) };
+			bench_routine( runner, path.filename().string(), rtn.get() );
+		}
+	}
+	else
+	{
+		logger::warning( "Corpus directory '%s' does not exist, skipping.", options.corpus.string() );
+	}
+
+	// Benchmark the synthetic routine.
+	//
+	std::unique_ptr<routine> synthetic{ make_synthetic_routine( options.synthetic_blocks, options.synthetic_size, options.seed ) };
+	bench_routine( runner, format::str( "synthetic_%llux%llu", options.synthetic_blocks, options.synthetic_size ), synthetic.get() );
+
+	// Benchmark the simplifier with both a cold and a warm cache.
+	//
+	auto expressions = make_synthetic_expressions( options.expression_count, options.expression_depth, options.seed );
+	runner.run( format::str( "simplify_expression/cold/%llux%llu", options.expression_count, options.expression_depth ),
+		[ & ] () { symbolic::purge_simplifier_state(); return expressions; },
+		[ ] ( auto& list ) { for ( auto& exp : list ) symbolic::simplify_expression( exp ); } );
+	runner.run( format::str( "simplify_expression/warm/%llux%llu", options.expression_count, options.expression_depth ),
+		[ & ] () { return expressions; },
+		[ ] ( auto& list ) { for ( auto& exp : list ) symbolic::simplify_expression( exp ); } );
+	runner.run( format::str( "simplify_expressions/cold/%llux%llu", options.expression_count, options.expression_depth ),
+		[ & ] () { symbolic::purge_simplifier_state(); return expressions; },
+		[ ] ( auto& list ) { symbolic::simplify_expressions( list ); } );
+	logger::log( "Simplifier cache: %s\n", symbolic::get_simplifier_cache_stats() );
+
+	// Benchmark the greedy simplifier against equality saturation on MBA expressions, the total
+	// complexity of the results is logged as a measure of quality.
+	//
+	auto mba_expressions = make_mba_expressions( options.mba_count, options.seed );
+	double mba_complexity[ 2 ] = { 0, 0 };
+	runner.run( format::str( "simplify_expression/mba/%llu", options.mba_count ),
+		[ & ] () { symbolic::purge_simplifier_state(); return mba_expressions; },
+		[ & ] ( auto& list ) 
+		{ 
+			mba_complexity[ 0 ] = 0;
+			for ( auto& exp : list ) 
+				symbolic::simplify_expression( exp ), mba_complexity[ 0 ] += exp->complexity();
+		} );
+	runner.run( format::str( "simplify_expression_saturated/mba/%llu", options.mba_count ),
+		[ & ] () { symbolic::purge_simplifier_state(); return mba_expressions; },
+		[ & ] ( auto& list ) 
+		{ 
+			mba_complexity[ 1 ] = 0;
+			for ( auto& exp : list ) 
+				symbolic::simplify_expression_saturated( exp ), mba_complexity[ 1 ] += exp->complexity();
+		} );
+	if ( mba_complexity[ 0 ] && mba_complexity[ 1 ] )
+		logger::log( "MBA result complexity: greedy %.2lf, saturation %.2lf\n", mba_complexity[ 0 ], mba_complexity[ 1 ] );
+
+	// Write the results, these are kept out of the standard output which the logger writes to.
+	//
+	std::ofstream out( options.output );
+	if ( !out )
+	{
+		logger::warning( "Failed to open '%s' for writing.", options.output.string() );
+		return 1;
+	}
+	runner.write_json( out );
+	logger::log( "Results written to '%s'.\n", options.output.string() );
+	return 0;
+}
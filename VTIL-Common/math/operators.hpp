@@ -390,6 +390,76 @@ namespace vtil::math
         return { result & fill( bcnt_res ), bcnt_res };
     }
 
+    // Applies the specified operator [id] on each lane of left hand side [lhs] and right hand side [rhs],
+    // writing the masked results into [out]. Equivalent to invoking ::evaluate for each lane, but common
+    // operators are handled with branch-free loops over the lanes so that they can be vectorized.
+    //
+    template<size_t N>
+    static constexpr void evaluate_lanes( operator_id id, bitcnt_t bcnt_lhs, const uint64_t* lhs, bitcnt_t bcnt_rhs, const uint64_t* rhs, uint64_t* out )
+    {
+        // Extends each lane of the input from the given size, booleans are never sign extended
+        // to match the behaviour of ::sign_extend.
+        //
+        const auto extend = [ ] ( uint64_t* dst, const uint64_t* src, bitcnt_t bcnt, bool is_signed )
+        {
+            uint64_t mask = fill( bcnt );
+            uint64_t sign = is_signed && bcnt != 1 && bcnt != 64 ? 1ull << ( bcnt - 1 ) : 0;
+            for ( size_t i = 0; i != N; i++ )
+                dst[ i ] = ( ( src[ i ] & mask ) ^ sign ) - sign;
+        };
+
+        // Redirect to the scalar implementation for the less common operators.
+        //
+        switch ( id )
+        {
+            case operator_id::bitwise_not:
+            case operator_id::negate:
+            case operator_id::bitwise_and:
+            case operator_id::bitwise_or:
+            case operator_id::bitwise_xor:
+            case operator_id::add:
+            case operator_id::subtract:
+            case operator_id::multiply:
+            case operator_id::umultiply:
+                break;
+            default:
+                for ( size_t i = 0; i != N; i++ )
+                    out[ i ] = evaluate( id, bcnt_lhs, lhs[ i ], bcnt_rhs, rhs[ i ] ).first;
+                return;
+        }
+
+        // Normalize the input.
+        //
+        const operator_desc& desc = descriptor_of( id );
+        uint64_t xlhs[ N ] = {};
+        uint64_t xrhs[ N ];
+        if ( desc.operand_count != 1 )
+            extend( xlhs, lhs, bcnt_lhs, desc.is_signed );
+        extend( xrhs, rhs, bcnt_rhs, desc.is_signed );
+
+        // Calculate the result of the operation.
+        //
+        switch ( id )
+        {
+            case operator_id::bitwise_not:      for ( size_t i = 0; i != N; i++ ) out[ i ] = ~xrhs[ i ];                break;
+            case operator_id::negate:           for ( size_t i = 0; i != N; i++ ) out[ i ] = 0 - xrhs[ i ];             break;
+            case operator_id::bitwise_and:      for ( size_t i = 0; i != N; i++ ) out[ i ] = xlhs[ i ] & xrhs[ i ];     break;
+            case operator_id::bitwise_or:       for ( size_t i = 0; i != N; i++ ) out[ i ] = xlhs[ i ] | xrhs[ i ];     break;
+            case operator_id::bitwise_xor:      for ( size_t i = 0; i != N; i++ ) out[ i ] = xlhs[ i ] ^ xrhs[ i ];     break;
+            case operator_id::add:              for ( size_t i = 0; i != N; i++ ) out[ i ] = xlhs[ i ] + xrhs[ i ];     break;
+            case operator_id::subtract:         for ( size_t i = 0; i != N; i++ ) out[ i ] = xlhs[ i ] - xrhs[ i ];     break;
+            case operator_id::multiply:
+            case operator_id::umultiply:        for ( size_t i = 0; i != N; i++ ) out[ i ] = xlhs[ i ] * xrhs[ i ];     break;
+            default:                            unreachable();
+        }
+
+        // Mask the result.
+        //
+        uint64_t mask = fill( result_size( id, bcnt_lhs, bcnt_rhs ) );
+        for ( size_t i = 0; i != N; i++ )
+            out[ i ] &= mask;
+    }
+
     // Applies the specified operator [op] on left hand side [lhs] and right hand side [rhs] where
     // input and output values are expressed in the format of bit-vectors with optional unknowns,
     // and no size constraints.
@@ -0,0 +1,671 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+// 3. Neither the name of VTIL Project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#include <stdint.h>
+#include <numeric>
+#include <algorithm>
+#include <optional>
+#include "bitwise.hpp"
+#include "operators.hpp"
+
+namespace vtil::math
+{
+    // Abstract value of an integer describing the bounds of its zero extended and sign extended
+    // forms along with a stride, complements the known bits tracked by the bit-vector.
+    //
+    struct value_range
+    {
+        // Bounds of the value when zero extended.
+        //
+        uint64_t umin = 0;
+        uint64_t umax = ~0ull;
+
+        // Bounds of the value when sign extended as done by ::sign_extend.
+        //
+        int64_t smin = INT64_MIN;
+        int64_t smax = INT64_MAX;
+
+        // All values are congruent to [umin] modulo the stride, zero if the value is known.
+        //
+        uint64_t stride = 1;
+
+        // Bounds of the signed values that can be represented with the given number of bits,
+        // booleans are never sign extended.
+        //
+        static constexpr int64_t signed_min( bitcnt_t bcnt ) { return bcnt == 1 ? 0 : int64_t( fill( 64, bcnt - 1 ) ); }
+        static constexpr int64_t signed_max( bitcnt_t bcnt ) { return bcnt == 1 ? 1 : int64_t( fill( bcnt - 1 ) ); }
+
+        // Sign extension matching ::sign_extend, inlined as it is on the hot path.
+        //
+        static constexpr int64_t sx( uint64_t value, bitcnt_t bcnt )
+        {
+            if ( bcnt == 1 ) return int64_t( value & 1 );
+            return int64_t( value << ( 64 - bcnt ) ) >> ( 64 - bcnt );
+        }
+
+        // Bit tricks used in place of ::msb and ::lsb as they are on the hot path, returns the mask of
+        // bits up to and including the highest set bit and the lowest set bit respectively.
+        //
+        static constexpr uint64_t smear( uint64_t x )
+        {
+            x |= x >> 1; x |= x >> 2; x |= x >> 4;
+            x |= x >> 8; x |= x >> 16; x |= x >> 32;
+            return x;
+        }
+        static constexpr uint64_t lowest( uint64_t x ) { return x & ( 0 - x ); }
+
+        // Constructs the range of all values of the given size.
+        //
+        static constexpr value_range full( bitcnt_t bcnt )
+        {
+            return { 0, fill( bcnt ), signed_min( bcnt ), signed_max( bcnt ), 1 };
+        }
+
+        // Constructs the range of a constant.
+        //
+        static constexpr value_range constant( uint64_t value, bitcnt_t bcnt )
+        {
+            value &= fill( bcnt );
+            int64_t svalue = sx( value, bcnt );
+            return { value, value, svalue, svalue, 0 };
+        }
+
+        // Constructs the range from the known bits of the bit-vector.
+        //
+        static constexpr value_range from_bits( const bit_vector& bv )
+        {
+            bitcnt_t bcnt = bv.size();
+            if ( bv.unknown_mask() == fill( bcnt ) )
+                return full( bcnt );
+
+            uint64_t lo = bv.known_one();
+            uint64_t hi = bv.known_one() | bv.unknown_mask();
+
+            value_range result = { lo, hi, sx( lo, bcnt ), sx( hi, bcnt ), 0 };
+            if ( bv.unknown_mask() )
+                result.stride = lowest( bv.unknown_mask() );
+
+            // If the sign bit is unknown, signed bounds are formed by setting and clearing it.
+            //
+            uint64_t sign = 1ull << ( bcnt - 1 );
+            if ( bcnt != 1 && ( bv.unknown_mask() & sign ) )
+            {
+                result.smin = sx( lo | sign, bcnt );
+                result.smax = sx( hi & ~sign, bcnt );
+            }
+            return result;
+        }
+
+        // Simple helpers.
+        //
+        constexpr bool is_known() const { return umin == umax; }
+        constexpr bool is_full( bitcnt_t bcnt ) const
+        {
+            return stride == 1 && umin == 0 && umax == fill( bcnt ) && smin == signed_min( bcnt ) && smax == signed_max( bcnt );
+        }
+        constexpr bool contains( uint64_t value, bitcnt_t bcnt ) const
+        {
+            value &= fill( bcnt );
+            int64_t svalue = sx( value, bcnt );
+            return umin <= value && value <= umax &&
+                   smin <= svalue && svalue <= smax &&
+                   ( stride == 0 ? value == umin : ( value - umin ) % stride == 0 );
+        }
+
+        // Propagates the information between the signed and unsigned bounds and aligns the bounds
+        // with the stride, returns false if the range is empty.
+        //
+        constexpr bool normalize( bitcnt_t bcnt )
+        {
+            const uint64_t mask = fill( bcnt );
+            const uint64_t sign = 1ull << ( bcnt - 1 );
+            umax = std::min( umax, mask );
+            smin = std::max( smin, signed_min( bcnt ) );
+            smax = std::min( smax, signed_max( bcnt ) );
+            if ( is_full( bcnt ) )
+                return true;
+
+            // Raises the unsigned lower bound, keeping it congruent to the previous one.
+            //
+            const auto raise_umin = [ & ] ( uint64_t bound )
+            {
+                if ( bound <= umin ) return true;
+                if ( stride <= 1 ) { umin = bound; return true; }
+                uint64_t delta = ( stride - ( bound - umin ) % stride ) % stride;
+                if ( bound + delta < bound ) return false;
+                umin = bound + delta;
+                return true;
+            };
+
+            for ( int pass = 0; pass != 2; pass++ )
+            {
+                // Booleans have identical signed and unsigned forms.
+                //
+                if ( bcnt == 1 )
+                {
+                    if ( !raise_umin( uint64_t( std::max<int64_t>( smin, 0 ) ) ) ) return false;
+                    if ( smax < 0 ) return false;
+                    umax = std::min( umax, uint64_t( smax ) );
+                    smin = int64_t( umin );
+                    smax = int64_t( umax );
+                }
+                else
+                {
+                    // Signed bounds with the same sign map to unsigned bounds.
+                    //
+                    if ( smin >= 0 || smax < 0 )
+                    {
+                        if ( !raise_umin( uint64_t( smin ) & mask ) ) return false;
+                        umax = std::min( umax, uint64_t( smax ) & mask );
+                    }
+
+                    // Unsigned bounds on either side of the sign bit map to signed bounds.
+                    //
+                    if ( umax < sign || umin >= sign )
+                    {
+                        smin = std::max( smin, sx( umin, bcnt ) );
+                        smax = std::min( smax, sx( umax, bcnt ) );
+                    }
+                }
+
+                // Align the upper bound with the stride.
+                //
+                if ( umin > umax || smin > smax )
+                    return false;
+                if ( stride > 1 )
+                    umax -= ( umax - umin ) % stride;
+            }
+
+            // If reduced to a single value, normalize the stride.
+            //
+            if ( umin == umax )
+            {
+                stride = 0;
+                smin = smax = sx( umin, bcnt );
+            }
+            return true;
+        }
+
+        // Intersects the two ranges, both should be describing the same value.
+        //
+        static constexpr value_range meet( const value_range& a, const value_range& b, bitcnt_t bcnt )
+        {
+            if ( b.is_full( bcnt ) ) return a;
+            if ( a.is_full( bcnt ) ) return b;
+
+            // Pick the more restrictive stride, known values always win.
+            //
+            const value_range& base = ( a.stride == 0 || ( b.stride != 0 && a.stride >= b.stride ) ) ? a : b;
+            value_range result = {
+                base.umin, std::min( a.umax, b.umax ),
+                std::max( a.smin, b.smin ), std::min( a.smax, b.smax ),
+                base.stride
+            };
+            if ( result.stride == 0 )
+                result.stride = 1, result.umax = std::min( result.umax, base.umin );
+            if ( result.normalize( bcnt ) )
+            {
+                value_range bounds = result;
+                bounds.stride = 1;
+                bounds.umin = std::max( a.umin, b.umin );
+                if ( result.stride <= 1 || bounds.umin <= result.umin )
+                {
+                    result.umin = std::max( result.umin, bounds.umin );
+                    if ( result.normalize( bcnt ) )
+                        return result;
+                }
+                else
+                {
+                    uint64_t delta = ( result.stride - ( bounds.umin - result.umin ) % result.stride ) % result.stride;
+                    if ( bounds.umin + delta >= bounds.umin && bounds.umin + delta <= result.umax )
+                    {
+                        result.umin = bounds.umin + delta;
+                        if ( result.normalize( bcnt ) )
+                            return result;
+                    }
+                }
+            }
+
+            // Empty intersection implies one of the ranges was not describing the value,
+            // fallback to the first one.
+            //
+            return a;
+        }
+
+        // Refines the known bits of the bit-vector describing the same value.
+        //
+        constexpr bit_vector refine( const bit_vector& bv ) const
+        {
+            // Bits shared by the bounds and bits below the stride's lowest set bit are known.
+            //
+            uint64_t known = ~smear( umin ^ umax );
+            if ( stride == 0 )     known = ~0ull;
+            else if ( stride > 1 ) known |= lowest( stride ) - 1;
+
+            uint64_t unknown = bv.unknown_mask() & ~known;
+            return { bv.known_one() | ( umin & bv.unknown_mask() & known ), unknown, bv.size() };
+        }
+
+        // Conversion to human-readable format.
+        //
+        std::string to_string() const
+        {
+            if ( stride > 1 )
+                return format::str( "[0x%llx, 0x%llx] / [%lld, %lld] %% 0x%llx", umin, umax, smin, smax, stride );
+            return format::str( "[0x%llx, 0x%llx] / [%lld, %lld]", umin, umax, smin, smax );
+        }
+    };
+
+    namespace impl
+    {
+        // Range over integers used as the intermediate form during arithmetic, values are
+        // congruent to [lo] modulo the stride.
+        //
+        struct wide_range
+        {
+            int64_t lo = 0;
+            int64_t hi = 0;
+            uint64_t stride = 1;
+            bool valid = false;
+        };
+
+        // Overflow checked arithmetic.
+        //
+        static constexpr bool checked_add( int64_t a, int64_t b, int64_t& out )
+        {
+            if ( b > 0 ? a > INT64_MAX - b : a < INT64_MIN - b ) return false;
+            out = a + b;
+            return true;
+        }
+        static constexpr bool checked_sub( int64_t a, int64_t b, int64_t& out )
+        {
+            if ( b < 0 ? a > INT64_MAX + b : a < INT64_MIN + b ) return false;
+            out = a - b;
+            return true;
+        }
+        static constexpr bool checked_mul( int64_t a, int64_t b, int64_t& out )
+        {
+            if ( a == 0 || b == 0 ) { out = 0; return true; }
+            uint64_t ua = a < 0 ? 0 - uint64_t( a ) : uint64_t( a );
+            uint64_t ub = b < 0 ? 0 - uint64_t( b ) : uint64_t( b );
+            if ( ua > UINT64_MAX / ub ) return false;
+            uint64_t p = ua * ub;
+            bool negative = ( a < 0 ) != ( b < 0 );
+            if ( p > ( negative ? ( 1ull << 63 ) : uint64_t( INT64_MAX ) ) ) return false;
+            out = negative ? int64_t( 0 - p ) : int64_t( p );
+            return true;
+        }
+        static constexpr uint64_t checked_stride_mul( uint64_t stride, uint64_t k )
+        {
+            if ( stride == 0 || k == 0 ) return 0;
+            if ( stride > UINT32_MAX || k > UINT32_MAX ) return 1;
+            return stride * k;
+        }
+
+        // Converts the unsigned or signed form of the range into a wide range.
+        //
+        static constexpr wide_range widen( const value_range& r, bool as_signed )
+        {
+            if ( as_signed )
+                return { r.smin, r.smax, uint64_t( r.smin == r.smax ? 0 : 1 ), true };
+            if ( r.umax > uint64_t( INT64_MAX ) )
+                return {};
+            return { int64_t( r.umin ), int64_t( r.umax ), r.stride, true };
+        }
+
+        // Wraps the wide range into the given number of bits.
+        //
+        static constexpr value_range narrow( const wide_range& w, bitcnt_t bcnt )
+        {
+            value_range result = value_range::full( bcnt );
+            if ( !w.valid )
+                return result;
+
+            // If the range does not cross a multiple of 2^N, unsigned bounds are the wrapped bounds.
+            //
+            bool exact = false;
+            if ( bcnt == 64 ) exact = w.lo >= 0 || w.hi < 0;
+            else              exact = ( w.lo >> bcnt ) == ( w.hi >> bcnt );
+            if ( exact )
+            {
+                result.umin = uint64_t( w.lo ) & fill( bcnt );
+                result.umax = uint64_t( w.hi ) & fill( bcnt );
+                result.stride = w.stride == 0 ? 0 : w.stride;
+                if ( result.stride == 0 && result.umin != result.umax )
+                    result.stride = 1;
+            }
+            // Otherwise, stride is still valid if it divides 2^N.
+            //
+            else if ( w.stride > 1 && ( w.stride & ( w.stride - 1 ) ) == 0 && ( bcnt == 64 || w.stride <= ( 1ull << bcnt ) ) )
+            {
+                result.stride = w.stride;
+                result.umin = uint64_t( w.lo ) & ( w.stride - 1 );
+            }
+
+            // Same for the signed bounds with the range shifted by 2^(N-1).
+            //
+            if ( bcnt == 64 )
+            {
+                result.smin = w.lo;
+                result.smax = w.hi;
+            }
+            else if ( bcnt != 1 )
+            {
+                int64_t half = 1ll << ( bcnt - 1 );
+                int64_t lo = 0, hi = 0;
+                if ( checked_add( w.lo, half, lo ) && checked_add( w.hi, half, hi ) && ( lo >> bcnt ) == ( hi >> bcnt ) )
+                {
+                    result.smin = value_range::sx( uint64_t( w.lo ), bcnt );
+                    result.smax = value_range::sx( uint64_t( w.hi ), bcnt );
+                }
+            }
+
+            if ( !result.normalize( bcnt ) )
+                return value_range::full( bcnt );
+            return result;
+        }
+
+        // Applies an arithmetic operator to wide ranges.
+        //
+        static constexpr wide_range evaluate_wide( operator_id id, const wide_range& a, const wide_range& b )
+        {
+            wide_range result = {};
+            if ( !a.valid || !b.valid )
+                return result;
+
+            switch ( id )
+            {
+                case operator_id::add:
+                    result.valid = checked_add( a.lo, b.lo, result.lo ) && checked_add( a.hi, b.hi, result.hi );
+                    result.stride = std::gcd( a.stride, b.stride );
+                    break;
+                case operator_id::subtract:
+                    result.valid = checked_sub( a.lo, b.hi, result.lo ) && checked_sub( a.hi, b.lo, result.hi );
+                    result.stride = std::gcd( a.stride, b.stride );
+                    break;
+                case operator_id::multiply:
+                case operator_id::umultiply:
+                {
+                    // If either side is a constant, scale the other side along with its stride.
+                    //
+                    const wide_range* var = &a;
+                    const wide_range* cst = &b;
+                    if ( a.stride == 0 && a.lo == a.hi ) std::swap( var, cst );
+                    if ( cst->stride == 0 && cst->lo == cst->hi )
+                    {
+                        int64_t k = cst->lo;
+                        if ( k >= 0 )
+                            result.valid = checked_mul( var->lo, k, result.lo ) && checked_mul( var->hi, k, result.hi );
+                        else
+                            result.valid = checked_mul( var->hi, k, result.lo ) && checked_mul( var->lo, k, result.hi );
+                        result.stride = checked_stride_mul( var->stride, k < 0 ? 0 - uint64_t( k ) : uint64_t( k ) );
+                        break;
+                    }
+
+                    // Otherwise, take the extremes of the products.
+                    //
+                    int64_t p[ 4 ] = {};
+                    result.valid = checked_mul( a.lo, b.lo, p[ 0 ] ) && checked_mul( a.lo, b.hi, p[ 1 ] ) &&
+                                   checked_mul( a.hi, b.lo, p[ 2 ] ) && checked_mul( a.hi, b.hi, p[ 3 ] );
+                    result.lo = std::min( { p[ 0 ], p[ 1 ], p[ 2 ], p[ 3 ] } );
+                    result.hi = std::max( { p[ 0 ], p[ 1 ], p[ 2 ], p[ 3 ] } );
+                    result.stride = 1;
+                    break;
+                }
+                default:
+                    break;
+            }
+            if ( result.valid && result.lo == result.hi )
+                result.stride = 0;
+            return result;
+        }
+    };
+
+    // Applies the specified operator [id] on the ranges of left hand side [lhs] and right hand
+    // side [rhs] producing the range of a result of size [bcnt_res]. Unhandled operators or operand
+    // sizes produce the full range.
+    //
+    static constexpr value_range evaluate_range( operator_id id, bitcnt_t bcnt_lhs, const value_range& lhs, bitcnt_t bcnt_rhs, const value_range& rhs, bitcnt_t bcnt_res )
+    {
+        const uint64_t mask = fill( bcnt_res );
+        value_range result = value_range::full( bcnt_res );
+        const auto boolean = [ ] ( std::optional<bool> v ) { return v ? value_range::constant( *v, 1 ) : value_range::full( 1 ); };
+
+        switch ( id )
+        {
+            // - Arithmetic operators, evaluated over both the signed and unsigned forms.
+            //
+            case operator_id::add:
+            case operator_id::subtract:
+            case operator_id::multiply:
+            case operator_id::umultiply:
+            case operator_id::negate:
+            {
+                // Nothing to derive if the operands are unbounded.
+                //
+                if ( rhs.is_full( bcnt_rhs ) || ( id != operator_id::negate && lhs.is_full( bcnt_lhs ) ) )
+                    break;
+
+                const bool unary = id == operator_id::negate;
+                if ( bcnt_rhs != bcnt_res || ( !unary && bcnt_lhs != bcnt_res ) )
+                    break;
+
+                operator_id op = unary ? operator_id::subtract : id;
+                value_range zero = value_range::constant( 0, bcnt_res );
+                const value_range& a = unary ? zero : lhs;
+                result = impl::narrow( impl::evaluate_wide( op, impl::widen( a, false ), impl::widen( rhs, false ) ), bcnt_res );
+                result = value_range::meet( result, impl::narrow( impl::evaluate_wide( op, impl::widen( a, true ), impl::widen( rhs, true ) ), bcnt_res ), bcnt_res );
+                break;
+            }
+
+            // - Bitwise operators.
+            //
+            case operator_id::bitwise_not:
+            {
+                if ( bcnt_rhs != bcnt_res )
+                    break;
+                result.umin = mask - rhs.umax;
+                result.umax = mask - rhs.umin;
+                result.stride = rhs.stride;
+                if ( bcnt_res != 1 )
+                {
+                    result.smin = ~rhs.smax;
+                    result.smax = ~rhs.smin;
+                }
+                break;
+            }
+            case operator_id::bitwise_and:
+            {
+                if ( bcnt_lhs != bcnt_res || bcnt_rhs != bcnt_res )
+                    break;
+                result.umax = std::min( lhs.umax, rhs.umax );
+                break;
+            }
+            case operator_id::bitwise_or:
+            {
+                if ( bcnt_lhs != bcnt_res || bcnt_rhs != bcnt_res )
+                    break;
+                result.umin = std::max( lhs.umin, rhs.umin );
+                result.umax = value_range::smear( lhs.umax | rhs.umax );
+                break;
+            }
+            case operator_id::bitwise_xor:
+            {
+                if ( bcnt_lhs != bcnt_res || bcnt_rhs != bcnt_res )
+                    break;
+                result.umax = value_range::smear( lhs.umax | rhs.umax );
+                break;
+            }
+            case operator_id::shift_right:
+            {
+                if ( bcnt_lhs != bcnt_res )
+                    break;
+                if ( rhs.umin >= uint64_t( bcnt_lhs ) )
+                    return value_range::constant( 0, bcnt_res );
+                result.umax = lhs.umax >> rhs.umin;
+                if ( rhs.umax < uint64_t( bcnt_lhs ) )
+                    result.umin = lhs.umin >> rhs.umax;
+                break;
+            }
+            case operator_id::shift_left:
+            {
+                if ( bcnt_lhs != bcnt_res )
+                    break;
+                if ( rhs.umin >= uint64_t( bcnt_lhs ) )
+                    return value_range::constant( 0, bcnt_res );
+                if ( rhs.is_known() && lhs.umax <= ( mask >> rhs.umin ) )
+                {
+                    result.umin = lhs.umin << rhs.umin;
+                    result.umax = lhs.umax << rhs.umin;
+                    result.stride = impl::checked_stride_mul( lhs.stride, 1ull << rhs.umin );
+                }
+                break;
+            }
+
+            // - Unsigned division and remainder by a non-zero divisor.
+            //
+            case operator_id::udivide:
+            {
+                if ( bcnt_lhs != bcnt_res || bcnt_rhs != bcnt_res || rhs.umin == 0 )
+                    break;
+                result.umin = lhs.umin / rhs.umax;
+                result.umax = lhs.umax / rhs.umin;
+                break;
+            }
+            case operator_id::uremainder:
+            {
+                if ( bcnt_lhs != bcnt_res || bcnt_rhs != bcnt_res || rhs.umin == 0 )
+                    break;
+                if ( lhs.umax < rhs.umin )
+                    result = lhs;
+                else
+                    result.umax = std::min( lhs.umax, rhs.umax - 1 );
+                break;
+            }
+
+            // - Conditional value, union of zero and right hand side.
+            //
+            case operator_id::value_if:
+            {
+                if ( bcnt_rhs != bcnt_res )
+                    break;
+                if ( bcnt_lhs == 1 && lhs.umin == 1 )
+                    return rhs;
+                if ( bcnt_lhs == 1 && lhs.umax == 0 )
+                    return value_range::constant( 0, bcnt_res );
+                result.umax = rhs.umax;
+                result.smin = std::min<int64_t>( rhs.smin, 0 );
+                result.smax = std::max<int64_t>( rhs.smax, 0 );
+                result.stride = std::gcd( rhs.stride, rhs.umin );
+                if ( result.stride == 0 )
+                    return value_range::constant( 0, bcnt_res );
+                break;
+            }
+
+            // - Resizing operators.
+            //
+            case operator_id::ucast:
+            {
+                if ( lhs.umax <= mask )
+                {
+                    result.umin = lhs.umin;
+                    result.umax = lhs.umax;
+                    result.stride = lhs.stride;
+                }
+                break;
+            }
+            case operator_id::cast:
+            {
+                if ( bcnt_lhs == 1 || bcnt_res == 1 )
+                    break;
+                if ( lhs.smin >= value_range::signed_min( bcnt_res ) && lhs.smax <= value_range::signed_max( bcnt_res ) )
+                {
+                    result.smin = lhs.smin;
+                    result.smax = lhs.smax;
+                    if ( lhs.smin >= 0 )
+                    {
+                        result.umin = lhs.umin;
+                        result.umax = lhs.umax;
+                        result.stride = lhs.stride;
+                    }
+                }
+                break;
+            }
+
+            // - Comparison operators.
+            //
+            case operator_id::greater:
+                return boolean( lhs.smin > rhs.smax ? std::optional{ true } : lhs.smax <= rhs.smin ? std::optional{ false } : std::nullopt );
+            case operator_id::greater_eq:
+                return boolean( lhs.smin >= rhs.smax ? std::optional{ true } : lhs.smax < rhs.smin ? std::optional{ false } : std::nullopt );
+            case operator_id::less:
+                return boolean( lhs.smax < rhs.smin ? std::optional{ true } : lhs.smin >= rhs.smax ? std::optional{ false } : std::nullopt );
+            case operator_id::less_eq:
+                return boolean( lhs.smax <= rhs.smin ? std::optional{ true } : lhs.smin > rhs.smax ? std::optional{ false } : std::nullopt );
+            case operator_id::ugreater:
+                return boolean( lhs.umin > rhs.umax ? std::optional{ true } : lhs.umax <= rhs.umin ? std::optional{ false } : std::nullopt );
+            case operator_id::ugreater_eq:
+                return boolean( lhs.umin >= rhs.umax ? std::optional{ true } : lhs.umax < rhs.umin ? std::optional{ false } : std::nullopt );
+            case operator_id::uless:
+                return boolean( lhs.umax < rhs.umin ? std::optional{ true } : lhs.umin >= rhs.umax ? std::optional{ false } : std::nullopt );
+            case operator_id::uless_eq:
+                return boolean( lhs.umax <= rhs.umin ? std::optional{ true } : lhs.umin > rhs.umax ? std::optional{ false } : std::nullopt );
+            case operator_id::equal:
+            case operator_id::not_equal:
+            case operator_id::uequal:
+            case operator_id::unot_equal:
+            {
+                // Determine whether the values are always or never equal, unsigned bounds are
+                // only comparable for signed comparison if the sizes match and vice versa.
+                //
+                bool is_signed = id == operator_id::equal || id == operator_id::not_equal;
+                bool use_unsigned = !is_signed || bcnt_lhs == bcnt_rhs;
+                bool use_signed = is_signed || bcnt_lhs == bcnt_rhs;
+
+                std::optional<bool> eq = std::nullopt;
+                if ( lhs.is_known() && rhs.is_known() )
+                    eq = is_signed ? lhs.smin == rhs.smin : lhs.umin == rhs.umin;
+                else if ( use_unsigned && ( lhs.umax < rhs.umin || rhs.umax < lhs.umin ) )
+                    eq = false;
+                else if ( use_signed && ( lhs.smax < rhs.smin || rhs.smax < lhs.smin ) )
+                    eq = false;
+                else if ( uint64_t g = std::gcd( lhs.stride, rhs.stride ); use_unsigned && g > 1 && ( std::max( lhs.umin, rhs.umin ) - std::min( lhs.umin, rhs.umin ) ) % g )
+                    eq = false;
+
+                bool negate = id == operator_id::not_equal || id == operator_id::unot_equal;
+                return boolean( eq ? std::optional{ *eq != negate } : std::nullopt );
+            }
+            default:
+                break;
+        }
+
+        if ( !result.normalize( bcnt_res ) )
+            return value_range::full( bcnt_res );
+        return result;
+    }
+};
\ No newline at end of file
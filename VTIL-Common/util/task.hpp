@@ -3,6 +3,15 @@
 #include <future>
 #include <optional>
 #include <memory>
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <exception>
+#include <algorithm>
 #include "type_helpers.hpp"
 
 // [Configuration]
@@ -12,6 +21,13 @@
 	#define VTIL_USE_THREAD_POOLING     true
 #endif
 
+// [Configuration]
+// Determine the number of worker threads the task pool will spawn.
+//
+#ifndef VTIL_TASK_POOL_SIZE
+	#define VTIL_TASK_POOL_SIZE         std::max( std::thread::hardware_concurrency(), 1u )
+#endif
+
 namespace vtil::task
 {
 	// Declare task controller.
@@ -34,9 +50,54 @@ namespace vtil::task
 		}
 	};
 
+	// Declare task context, the thread-local state that belongs to the task running on the thread
+	// rather than the thread itself such as recursion guards and scoped settings. A thread helping 
+	// the pool while waiting saves it and resets it before running the item it picked up.
+	//
+	struct task_context
+	{
+		// Entry of the context, registers itself to the current thread on construction.
+		//
+		struct entry
+		{
+			entry() { entries.emplace_back( this ); }
+			entry( const entry& ) = delete;
+			entry& operator=( const entry& ) = delete;
+			virtual ~entry() { std::erase( entries, this ); }
+
+			// Pushes the current value and resets it, pops the last value pushed, resets the value.
+			//
+			virtual void save() = 0;
+			virtual void restore() = 0;
+			virtual void reset() = 0;
+		};
+		inline static thread_local std::vector<entry*> entries = {};
+
+		// Saves the context of the current thread, returns the number of entries saved.
+		//
+		static size_t save()
+		{
+			size_t count = entries.size();
+			for ( size_t n = 0; n != count; n++ )
+				entries[ n ]->save();
+			return count;
+		}
+
+		// Restores the context saved, entries created since then are reset.
+		//
+		static void restore( size_t count )
+		{
+			for ( size_t n = count; n < entries.size(); n++ )
+				entries[ n ]->reset();
+			for ( size_t n = 0; n != count; n++ )
+				entries[ n ]->restore();
+		}
+	};
+
 	// Declare task local, must always have the following signature:
+	// - If contextual, the value is also saved with the task context.
 	//
-	template<typename T>
+	template<typename T, bool contextual = false>
 	struct alignas( T ) local_variable
 	{
 		// Hold the value.
@@ -55,6 +116,35 @@ namespace vtil::task
 		//
 		const std::optional<T> default_value;
 
+		// Task context entry moving the value out when saved, the value is left uninitialized
+		// until the next use.
+		//
+		struct context_entry : task_context::entry
+		{
+			local_variable* owner;
+			std::vector<std::optional<T>> saved;
+
+			context_entry( local_variable* owner ) : owner( owner ) {}
+
+			void save() override 
+			{ 
+				saved.emplace_back( owner->init ? std::optional<T>{ owner->steal() } : std::nullopt ); 
+			}
+			void restore() override
+			{
+				owner->reset();
+				if ( auto& entry = saved.back() )
+				{
+					new ( &owner->value ) T( std::move( *entry ) );
+					owner->init = true;
+				}
+				saved.pop_back();
+			}
+			void reset() override { owner->reset(); }
+		};
+		struct no_context_entry { no_context_entry( local_variable* ) {} };
+		[[no_unique_address]] std::conditional_t<contextual, context_entry, no_context_entry> context = { this };
+
 		// Adds a callback to the task controller.
 		//
 		local_variable( std::optional<T> default_value = std::nullopt )
@@ -113,10 +203,266 @@ namespace vtil::task
 	};
 	#define task_local( ... ) thread_local vtil::task::local_variable<__VA_ARGS__> 
 
+	// Declare task context variable, a thread local that is saved with the task context.
+	//
+	template<typename T>
+	struct context_variable : task_context::entry
+	{
+		T value;
+		const T initial_value;
+		std::vector<T> saved;
+
+		// Construct by the initial value.
+		//
+		context_variable( T initial_value = {} ) 
+			: value( initial_value ), initial_value( std::move( initial_value ) ) {}
+
+		// Implement the context entry.
+		//
+		void save() override { saved.emplace_back( std::exchange( value, initial_value ) ); }
+		void restore() override { value = std::move( saved.back() ); saved.pop_back(); }
+		void reset() override { value = initial_value; }
+
+		// Simple accessors.
+		//
+		T& operator*() { return value; }
+		T* operator->() { return &value; }
+	};
+	#define task_context_local( ... ) thread_local vtil::task::context_variable<__VA_ARGS__> 
+
+	// A single unit of work queued into the pool.
+	//
+	struct work_item
+	{
+		// Function to invoke.
+		//
+		std::function<void()> fn;
+
+		// Exception thrown by the function if relevant.
+		//
+		std::exception_ptr exception = nullptr;
+
+		// Set once the function returns.
+		//
+		std::atomic<bool> done = { false };
+
+		// Constructed by the function.
+		//
+		work_item( std::function<void()> fn ) : fn( std::move( fn ) ) {}
+
+		// Invokes the function, saves any exception thrown and signals completion.
+		//
+		void run()
+		{
+			try
+			{
+				fn();
+			}
+			catch ( ... )
+			{
+				exception = std::current_exception();
+			}
+			done.store( true, std::memory_order_release );
+			done.notify_all();
+		}
+	};
+	using work_handle = std::shared_ptr<work_item>;
+
+	// Persistent work-stealing thread pool, each worker owns a deque and
+	// pops from the back of its own while stealing from the front of others.
+	//
+	struct thread_pool
+	{
+		// Per-worker queue.
+		//
+		struct worker_queue
+		{
+			std::mutex lock;
+			std::deque<work_handle> items;
+		};
+		std::vector<std::unique_ptr<worker_queue>> queues;
+		std::vector<std::thread> workers;
+
+		// Number of queued items and the signal idle workers sleep on.
+		//
+		std::atomic<size_t> pending = { 0 };
+		std::mutex signal_lock;
+		std::condition_variable signal;
+		bool stop = false;
+
+		// Round-robin counter used for submissions from outside the pool.
+		//
+		std::atomic<size_t> next_queue = { 0 };
+
+		// Pool and the index of the worker the current thread represents if any.
+		//
+		static constexpr size_t invalid_index = ~0ull;
+		inline static thread_local const thread_pool* worker_owner = nullptr;
+		inline static thread_local size_t worker_index = invalid_index;
+
+		// Spawns the workers, each begins and ends the task locals only once.
+		//
+		thread_pool( size_t count = VTIL_TASK_POOL_SIZE )
+		{
+			count = std::max<size_t>( count, 1 );
+			for ( size_t n = 0; n != count; n++ )
+				queues.emplace_back( std::make_unique<worker_queue>() );
+			for ( size_t n = 0; n != count; n++ )
+				workers.emplace_back( [ this, n ] () { worker( n ); } );
+		}
+
+		// No copy/move.
+		//
+		thread_pool( thread_pool&& ) = delete;
+		thread_pool( const thread_pool& ) = delete;
+		thread_pool& operator=( thread_pool&& ) = delete;
+		thread_pool& operator=( const thread_pool& ) = delete;
+
+		// Signals all workers to stop and joins them.
+		//
+		~thread_pool()
+		{
+			{
+				std::lock_guard _g( signal_lock );
+				stop = true;
+			}
+			signal.notify_all();
+			for ( auto& thread : workers )
+				thread.join();
+		}
+
+		// Gets the global pool.
+		//
+		static thread_pool& global()
+		{
+			static thread_pool pool = {};
+			return pool;
+		}
+
+		// Returns the number of workers.
+		//
+		size_t size() const { return workers.size(); }
+
+		// Checks whether the current thread is a worker of this pool.
+		//
+		bool is_worker() const { return worker_owner == this; }
+
+		// Queues a new work item.
+		//
+		work_handle submit( std::function<void()> fn )
+		{
+			auto item = std::make_shared<work_item>( std::move( fn ) );
+
+			// Push to the back of our own queue if we're a worker, otherwise distribute.
+			//
+			// - Pending count is incremented first so that a concurrent ::pop cannot decrement it below zero.
+			//
+			size_t idx = is_worker() ? worker_index : ( next_queue++ % queues.size() );
+			pending++;
+			{
+				std::lock_guard _g( queues[ idx ]->lock );
+				queues[ idx ]->items.emplace_back( item );
+			}
+
+			// Wake up an idle worker.
+			//
+			{
+				std::lock_guard _g( signal_lock );
+			}
+			signal.notify_one();
+			return item;
+		}
+
+		// Pops an item from the queue owned by the current thread or steals one from others.
+		//
+		work_handle pop()
+		{
+			if ( !pending.load( std::memory_order_relaxed ) )
+				return nullptr;
+
+			size_t own = is_worker() ? worker_index : invalid_index;
+			if ( own != invalid_index )
+			{
+				std::lock_guard _g( queues[ own ]->lock );
+				if ( auto& items = queues[ own ]->items; !items.empty() )
+				{
+					work_handle item = std::move( items.back() );
+					items.pop_back();
+					pending--;
+					return item;
+				}
+			}
+
+			size_t base = own == invalid_index ? 0 : own + 1;
+			for ( size_t n = 0; n != queues.size(); n++ )
+			{
+				size_t idx = ( base + n ) % queues.size();
+				if ( idx == own ) continue;
+
+				std::unique_lock lock( queues[ idx ]->lock, std::try_to_lock );
+				if ( !lock.owns_lock() ) continue;
+				if ( auto& items = queues[ idx ]->items; !items.empty() )
+				{
+					work_handle item = std::move( items.front() );
+					items.pop_front();
+					pending--;
+					return item;
+				}
+			}
+			return nullptr;
+		}
+
+		// Waits for the item to complete, executing other queued items in the meantime
+		// so that nested waits from within workers cannot dead-lock the pool, the task 
+		// context of the waiting thread is not visible to the items executed.
+		//
+		void wait( const work_handle& item )
+		{
+			while ( !item->done.load( std::memory_order_acquire ) )
+			{
+				if ( auto other = pop() )
+				{
+					size_t context = task_context::save();
+					other->run();
+					task_context::restore( context );
+				}
+				else if ( pending.load( std::memory_order_relaxed ) )
+					std::this_thread::yield();
+				else
+					item->done.wait( false, std::memory_order_acquire );
+			}
+			if ( item->exception )
+				std::rethrow_exception( item->exception );
+		}
+
+		// Worker loop.
+		//
+		void worker( size_t idx )
+		{
+			worker_owner = this;
+			worker_index = idx;
+			task_controller::begin();
+			while ( true )
+			{
+				if ( auto item = pop() )
+				{
+					item->run();
+					continue;
+				}
+
+				std::unique_lock lock( signal_lock );
+				signal.wait( lock, [ & ] () { return stop || pending.load() != 0; } );
+				if ( stop && !pending.load() )
+					break;
+			}
+			task_controller::end();
+		}
+	};
+
 	// Declare handle type.
 	// 
 #if VTIL_USE_THREAD_POOLING
-	using handle_type = std::future<void>;
+	using handle_type = work_handle;
 #else
 	using handle_type = std::thread;
 #endif
@@ -132,6 +478,12 @@ namespace vtil::task
 		template<typename T> requires Invocable<T, void>
 		instance( T&& fn )
 		{
+#if VTIL_USE_THREAD_POOLING
+			// Pool workers begin the task locals once per thread, so
+			// we can submit the function as is.
+			//
+			handle = thread_pool::global().submit( std::forward<T>( fn ) );
+#else
 			// Wrap around task markers.
 			//
 			auto f = [ fn = std::forward<T>( fn ) ]() 
@@ -140,31 +492,39 @@ namespace vtil::task
 				fn(); 
 				task_controller::end();
 			};
-
-#if VTIL_USE_THREAD_POOLING
-			handle = std::async( std::launch::async, std::move( f ) );
-#else
-			handle = { f };
+			handle = std::thread{ std::move( f ) };
 #endif
 		}
 
-		// Default move / copy.
+		// Default move, no copy.
 		//
 		instance( instance&& ) = default;
-		instance( const instance& ) = default;
+		instance( const instance& ) = delete;
 		instance& operator=( instance&& ) = default;
-		instance& operator=( const instance& ) = default;
+		instance& operator=( const instance& ) = delete;
 
-		// Destruction calls ::get if pooling is enabled to 
-		// propagate exceptions from std::future.
+		// Waits for the completion of the task, if pooling is enabled the
+		// current thread will help the pool while waiting and exceptions
+		// thrown by the task will be propagated.
 		//
-		~instance()
+		void wait()
 		{
 #if VTIL_USE_THREAD_POOLING
-			handle.get();
+			if ( auto h = std::exchange( handle, nullptr ) )
+				thread_pool::global().wait( h );
 #else
-			handle.join();
+			if ( handle.joinable() )
+				handle.join();
 #endif
 		}
+
+		// Destruction waits for the task, exceptions are discarded since they can 
+		// only be propagated from an explicit call to ::wait.
+		//
+		~instance()
+		{
+			try { wait(); }
+			catch ( ... ) {}
+		}
 	};
 };
\ No newline at end of file
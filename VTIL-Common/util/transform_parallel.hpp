@@ -28,6 +28,8 @@
 #pragma once
 #include <iterator>
 #include <vector>
+#include <atomic>
+#include <memory>
 #include "task.hpp"
 #include "type_helpers.hpp"
 #include "intrinsics.hpp"
@@ -66,9 +68,10 @@ namespace vtil
 		if ( !VTIL_USE_PARALLEL_TRANSFORM || container_size == 1 )
 		{
 			for ( auto it = std::begin( container ); it != std::end( container ); ++it )
-				return worker( *it );
+				worker( *it );
 		}
-		// Otherwise, create task pool and insert for each entry.
+		// Otherwise, queue each entry into the task pool and wait for all of
+		// them, propagating the first exception thrown if any.
 		//
 		else
 		{
@@ -76,6 +79,105 @@ namespace vtil
 			tasks.reserve( container_size );
 			for ( auto it = std::begin( container ); it != std::end( container ); ++it )
 				tasks.emplace_back( [ &worker, value = impl::ref_adjust( *it ) ] () {  worker( value );  } );
+
+			std::exception_ptr exception = nullptr;
+			for ( auto& task : tasks )
+			{
+				try
+				{
+					task.wait();
+				}
+				catch ( ... )
+				{
+					if ( !exception ) exception = std::current_exception();
+				}
+			}
+			if ( exception )
+				std::rethrow_exception( exception );
+		}
+	}
+	// Generic parallel worker helper for dependency graphs, the worker is invoked with the 
+	// index of each node as soon as every node it depends on is processed, with no barriers
+	// in between. Dependents are given as a list of node indices per node, graph must be acyclic.
+	//
+	template<typename F> requires Invocable<F, void, size_t>
+	static void transform_parallel_graph( const std::vector<std::vector<size_t>>& dependents, const F& worker )
+	{
+		size_t node_count = dependents.size();
+		if ( !node_count ) return;
+
+		// Calculate the number of dependencies of each node.
+		//
+		std::unique_ptr<std::atomic<size_t>[]> in_degree{ new std::atomic<size_t>[ node_count ] };
+		for ( size_t n = 0; n != node_count; n++ )
+			in_degree[ n ] = 0;
+		for ( auto& list : dependents )
+			for ( size_t n : list )
+				++in_degree[ n ];
+
+		// If parallel transformation is disabled or if the graph only has one entry, 
+		// fallback to serial transformation in topological order.
+		//
+		if ( !VTIL_USE_PARALLEL_TRANSFORM || node_count == 1 )
+		{
+			std::vector<size_t> queue;
+			for ( size_t n = 0; n != node_count; n++ )
+				if ( !in_degree[ n ] )
+					queue.emplace_back( n );
+			for ( size_t i = 0; i != queue.size(); i++ )
+			{
+				worker( queue[ i ] );
+				for ( size_t n : dependents[ queue[ i ] ] )
+					if ( !--in_degree[ n ] )
+						queue.emplace_back( n );
+			}
+			return;
 		}
+
+		// Declare the shared state, completion is signaled through a work item
+		// that is never queued so that the waiting thread can help the pool.
+		//
+		auto& pool = task::thread_pool::global();
+		auto completion = std::make_shared<task::work_item>( [ ] () {} );
+		std::atomic<size_t> remaining = { node_count };
+		std::exception_ptr exception = nullptr;
+		std::mutex exception_lock;
+
+		// Declare the dispatcher, each node releases its dependents once processed.
+		//
+		auto dispatch = [ & ] ( size_t idx, auto&& self ) -> void
+		{
+			pool.submit( [ &, idx, completion ] ()
+			{
+				try
+				{
+					worker( idx );
+				}
+				catch ( ... )
+				{
+					std::lock_guard _g( exception_lock );
+					if ( !exception ) exception = std::current_exception();
+				}
+
+				for ( size_t n : dependents[ idx ] )
+					if ( !--in_degree[ n ] )
+						self( n, self );
+				if ( !--remaining )
+					completion->run();
+			} );
+		};
+
+		// Collect the roots before dispatching any since the counters will
+		// start changing, dispatch each and wait for completion.
+		//
+		std::vector<size_t> roots;
+		for ( size_t n = 0; n != node_count; n++ )
+			if ( !in_degree[ n ] )
+				roots.emplace_back( n );
+		for ( size_t n : roots )
+			dispatch( n, dispatch );
+		pool.wait( completion );
+		if ( exception )
+			std::rethrow_exception( exception );
 	}
 };
\ No newline at end of file
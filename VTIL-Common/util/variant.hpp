@@ -141,6 +141,11 @@ namespace vtil
 			return *( const T* ) get_address(); 
 		}
 
+		// Checks whether the variant holds a value of the given type.
+		//
+		template<typename T>
+		bool is() const { return traits == vtype_traits_v<T>; }
+
 		// Cast to optional.
 		// - Unlike ::get, will not throw an assert failure if the variant
 		//   is empty and will return nullopt instead.
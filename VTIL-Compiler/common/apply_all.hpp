@@ -26,6 +26,9 @@
 // POSSIBILITY OF SUCH DAMAGE.        
 //
 #pragma once
+#include <span>
+#include <vector>
+#include <exception>
 #include "interface.hpp"
 #include "../optimizer/stack_pinning_pass.hpp"
 #include "../optimizer/istack_ref_substitution_pass.hpp"
@@ -132,4 +135,86 @@ namespace vtil::optimizer
 	//
 	static constexpr spawn_state<collective_pass> apply_all = {};
 	static constexpr spawn_state<apply_each<profile_pass, collective_pass>> apply_all_profiled = {};
+
+	// Passes the routine through the optimizer until it's done or until the budget is exhausted, 
+	// returns the number of optimizations applied, progress is reported in the budget.
+	//
+	template<typename T = collective_pass>
+	static size_t apply_all_budgeted( routine* rtn, optimization_budget& budget )
+	{
+		budget.begin();
+		scope_budget _b{ &budget };
+		return spawn_state<T>{}.xpass( rtn );
+	}
+
+	// Statistics of a single routine optimized as a part of a batch.
+	//
+	struct batch_statistics
+	{
+		routine* rtn = nullptr;
+		size_t optimization_count = 0;
+		size_t blocks_before = 0;
+		size_t blocks_after = 0;
+		size_t instructions_before = 0;
+		size_t instructions_after = 0;
+		timeunit_t time = {};
+
+		// Progress made within the budget.
+		//
+		size_t iterations = 0;
+		size_t simplifications = 0;
+		budget_state budget = budget_state::available;
+
+		// Set if the pass raised an exception, routine might be partially optimized.
+		//
+		std::exception_ptr exception = nullptr;
+	};
+
+	// Passes every routine given through the optimizer, scheduling the blocks of all routines
+	// on the shared task pool at once. Instead of saving a simplifier cache per block, each
+	// worker keeps its own warm cache across all routines. Routines must be unique, returns
+	// the statistics for each routine in the order they were given. Limits, if any, are 
+	// applied to each routine individually.
+	//
+	template<typename T = collective_pass>
+	static std::vector<batch_statistics> apply_all_batch( std::span<routine* const> routines, const budget_limits& limits = {} )
+	{
+		std::vector<batch_statistics> result( routines.size() );
+		for ( auto [stats, rtn] : zip( result, routines ) )
+			stats.rtn = rtn;
+
+		transform_parallel( result, [ & ] ( batch_statistics& stats )
+		{
+			routine* rtn = stats.rtn;
+
+			// Clear any restriction inherited from the task we might be nested in and 
+			// switch the routine to the worker caches.
+			//
+			scope_block_worklist _w{ nullptr };
+			rtn->context.get<impl::worker_cache_tag>();
+
+			stats.blocks_before = rtn->num_blocks();
+			stats.instructions_before = rtn->num_instructions();
+			optimization_budget budget{ limits };
+			stats.time = profile( [ & ] ()
+			{
+				try
+				{
+					stats.optimization_count = apply_all_budgeted<T>( rtn, budget );
+				}
+				catch ( ... )
+				{
+					stats.exception = std::current_exception();
+				}
+			} );
+			stats.blocks_after = rtn->num_blocks();
+			stats.instructions_after = rtn->num_instructions();
+			stats.iterations = budget.iterations;
+			stats.simplifications = budget.simplifications;
+			stats.budget = budget.state;
+
+			rtn->context.purge<impl::worker_cache_tag>();
+		} );
+		return result;
+	}
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of VTIL Project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software 
+//    without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <atomic>
+#include <vtil/utility>
+#include <vtil/symex>
+
+namespace vtil::optimizer
+{
+	// Reason an optimization budget was exhausted.
+	//
+	enum class budget_state
+	{
+		available,
+		time_limit,
+		simplification_limit,
+		iteration_limit,
+	};
+
+	// Limits of an optimization budget, zero means unlimited.
+	//
+	struct budget_limits
+	{
+		// Maximum wall time the optimization is allowed to take.
+		//
+		timeunit_t time_limit = {};
+
+		// Maximum number of simplifier invocations.
+		//
+		size_t max_simplifications = 0;
+
+		// Maximum number of exhaust_pass iterations over the routine.
+		//
+		size_t max_iterations = 0;
+	};
+
+	// Optimization budget, checked cooperatively by apply_pass and exhaust_pass which stop
+	// processing once it is exhausted, leaving the routine valid but partially optimized.
+	// Also serves as a progress report once the optimization is complete.
+	//
+	struct optimization_budget
+	{
+		budget_limits limits;
+
+		// Progress of the optimization.
+		//
+		timestamp_t start = time::now();
+		std::atomic<size_t> iterations = { 0 };
+		std::atomic<size_t> simplifications = { 0 };
+		std::atomic<budget_state> state = { budget_state::available };
+
+		// Construct from limits.
+		//
+		optimization_budget( const budget_limits& limits = {} ) : limits( limits ) {}
+
+		// No copy/move.
+		//
+		optimization_budget( const optimization_budget& ) = delete;
+		optimization_budget& operator=( const optimization_budget& ) = delete;
+
+		// Resets the progress and starts the timer.
+		//
+		void begin()
+		{
+			start = time::now();
+			iterations = 0;
+			simplifications = 0;
+			state = budget_state::available;
+		}
+
+		// Returns the time elapsed since the beginning.
+		//
+		timeunit_t elapsed() const { return time::now() - start; }
+
+		// Marks the budget exhausted for the given reason, first reason is kept.
+		//
+		void exhaust( budget_state reason )
+		{
+			budget_state expected = budget_state::available;
+			state.compare_exchange_strong( expected, reason );
+		}
+		bool exhausted() const { return state.load( std::memory_order_relaxed ) != budget_state::available; }
+
+		// Checks whether or not we are still within the budget.
+		//
+		bool check()
+		{
+			if ( exhausted() )
+				return false;
+			if ( limits.max_simplifications && simplifications.load( std::memory_order_relaxed ) >= limits.max_simplifications )
+				exhaust( budget_state::simplification_limit );
+			else if ( limits.time_limit != timeunit_t{} && elapsed() >= limits.time_limit )
+				exhaust( budget_state::time_limit );
+			return !exhausted();
+		}
+
+		// Consumes a single iteration, returns false if the budget does not allow it.
+		//
+		bool consume_iteration()
+		{
+			if ( !check() )
+				return false;
+			if ( limits.max_iterations && iterations.load() >= limits.max_iterations )
+			{
+				exhaust( budget_state::iteration_limit );
+				return false;
+			}
+			++iterations;
+			return true;
+		}
+	};
+
+	namespace impl
+	{
+		// Budget of the optimization currently running on this task, if any.
+		//
+		inline task_context_local( optimization_budget* ) active_budget = nullptr;
+	};
+
+	// RAII helper setting the active budget of the current task, null removes it. Simplifier 
+	// invocations made by the task are charged to the budget.
+	//
+	struct scope_budget
+	{
+		optimization_budget* prev;
+		std::atomic<size_t>* prev_counter;
+
+		scope_budget( optimization_budget* budget ) 
+			: prev( std::exchange( *impl::active_budget, budget ) ),
+			  prev_counter( symbolic::set_simplifier_invocation_counter( budget ? &budget->simplifications : nullptr ) ) {}
+		~scope_budget() 
+		{ 
+			symbolic::set_simplifier_invocation_counter( prev_counter );
+			*impl::active_budget = prev; 
+		}
+	};
+};
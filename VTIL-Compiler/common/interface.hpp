@@ -33,6 +33,17 @@
 #include <vtil/io>
 #include <vtil/symex>
 #include <vtil/arch>
+#include "budget.hpp"
+#include "profiler.hpp"
+
+// [Configuration]
+// Determine whether or not exhaust_pass should only re-run the passes on the blocks
+// modified by the previous iteration (and their neighbours) until a fixed-point
+// is reached, followed by a final full iteration confirming it.
+//
+#ifndef VTIL_OPT_INCREMENTAL_EXHAUST
+	#define VTIL_OPT_INCREMENTAL_EXHAUST true
+#endif
 
 namespace vtil::optimizer
 {
@@ -47,6 +58,24 @@ namespace vtil::optimizer
 			saved_cache() { }
 			saved_cache( const saved_cache& o ) { fassert( !o.state ); }
 		};
+
+		// Set of blocks apply_pass is currently restricted to, if any.
+		//
+		inline task_context_local( const path_set* ) block_worklist = nullptr;
+
+		// Routine context tag indicating that the blocks should be simplified using the warm 
+		// cache of the worker thread instead of a cache saved per block.
+		//
+		struct worker_cache_tag {};
+	};
+
+	// RAII helper restricting apply_pass to the given set of blocks, null removes the restriction.
+	//
+	struct scope_block_worklist
+	{
+		const path_set* prev;
+		scope_block_worklist( const path_set* worklist ) : prev( std::exchange( *impl::block_worklist, worklist ) ) {}
+		~scope_block_worklist() { *impl::block_worklist = prev; }
 	};
 
 	// Pass execution order.
@@ -65,27 +94,35 @@ namespace vtil::optimizer
 		parallel_df,
 	};
 
-	// RAII cache swap helper.
+	// RAII cache swap helper, the cache of the thread is set aside and restored on exit
+	// so that blocks processed while waiting for others do not take it over.
 	//
 	struct scope_simplifier_cache
 	{
-		impl::saved_cache& cache;
+		impl::saved_cache* cache = nullptr;
 		symbolic::simplifier_state_ptr pcache = nullptr;
 
 		scope_simplifier_cache( basic_block* block )
-			: cache( block->context )
 		{
-			// If there's a valid cache saved, swap.
+			// If the routine is using the worker caches, keep the current one.
+			//
+			if ( block->owner->context.has<impl::worker_cache_tag>() )
+				return;
+
+			// Swap the cache saved in the block in, allocating one if there is none.
 			//
-			if ( cache.state )
-				pcache = symbolic::swap_simplifier_state( std::move( cache.state ) );
+			cache = &block->context.get<impl::saved_cache>();
+			if ( !cache->state )
+				cache->state = symbolic::simplifier_state_allocator{}();
+			pcache = symbolic::swap_simplifier_state( std::move( cache->state ) );
 		}
 
 		~scope_simplifier_cache()
 		{
-			// Save current cache into the block.
+			// Save current cache into the block and restore the cache of the thread.
 			//
-			cache.state = symbolic::swap_simplifier_state( std::move( pcache ) );
+			if ( cache )
+				cache->state = symbolic::swap_simplifier_state( std::move( pcache ) );
 		}
 	};
 
@@ -95,12 +132,26 @@ namespace vtil::optimizer
 	template<typename T>
 	static auto apply_pass( routine* rtn, T* opt )
 	{
-		// Declare worker and allocate the final result.
+		// Declare worker and allocate the final result, skip the blocks
+		// that are not in the worklist if we're restricted to one or if 
+		// we've run out of budget.
 		//
 		std::atomic<size_t> n = { 0 };
+		const path_set* worklist = *impl::block_worklist;
+		optimization_budget* budget = *impl::active_budget;
+		auto is_scheduled = [ & ] ( const basic_block* block )
+		{
+			return !worklist || worklist->contains( block );
+		};
 		auto worker = [ & ] ( basic_block* block )
 		{
+			if ( !is_scheduled( block ) )
+				return;
+			if ( budget && !budget->check() )
+				return;
+
 			scope_simplifier_cache _s{ block };
+			scope_budget _b{ budget };
 			n += opt->pass( block, true );
 		};
 
@@ -153,10 +204,21 @@ namespace vtil::optimizer
 			{
 				// Invoke parallel transformation.
 				//
-				transform_parallel( rtn->explored_blocks, [ & ] ( const std::pair<const vip_t, basic_block*>& pair )
+				if ( !worklist )
 				{
-					worker( pair.second );
-				} );
+					transform_parallel( rtn->explored_blocks, [ & ] ( const std::pair<const vip_t, basic_block*>& pair )
+					{
+						worker( pair.second );
+					} );
+				}
+				else
+				{
+					std::vector<basic_block*> blocks;
+					for ( auto& [vip, block] : rtn->explored_blocks )
+						if ( is_scheduled( block ) )
+							blocks.emplace_back( block );
+					transform_parallel( blocks, worker );
+				}
 				break;
 			}
 			case execution_order::parallel_bf:
@@ -164,31 +226,53 @@ namespace vtil::optimizer
 			{
 				// Get depth ordered list.
 				//
-				auto entries = rtn->get_depth_ordered_list( T::exec_order == execution_order::parallel_bf );
+				bool fwd = T::exec_order == execution_order::parallel_bf;
+				auto entries = rtn->get_depth_ordered_list( fwd );
 
-				// Begin segmentation loop.
+				// Map each block to its entries.
 				//
-				auto it_begin = entries.begin();
-				while ( it_begin != entries.end() )
+				std::unordered_map<const basic_block*, std::vector<size_t>, hasher<>> placements;
+				placements.reserve( entries.size() );
+				for ( auto [entry, idx] : zip( entries, iindices ) )
+					placements[ entry.block ].emplace_back( idx );
+
+				// Adjacent blocks must never be processed at the same time, so every pair of entries
+				// linked in either direction is ordered from the lower level to the higher one. The
+				// list is sorted by level so this is the same as ordering by index, which also
+				// breaks the ties and keeps the graph acyclic.
+				//
+				std::vector<std::vector<size_t>> dependents( entries.size() );
+				for ( auto [entry, idx] : zip( entries, iindices ) )
 				{
-					// Find the last iterator with matching dependency.
-					//
-					auto it_end = it_begin;
-					while ( it_end != entries.end() &&
-							it_end->level_dependency == it_begin->level_dependency )
-						it_end++;
-
-					// Queue segment for work.
-					//
-					transform_parallel( make_range( it_begin, it_end ), [ & ] ( const routine::depth_placement& entry )
+					for ( auto* links : { &entry.block->next, &entry.block->prev } )
 					{
-						return worker( make_mutable( entry.block ) );
-					} );
-
-					// Continue search from next segment.
-					//
-					it_begin = it_end;
+						for ( auto* dst : *links )
+						{
+							auto it = placements.find( dst );
+							if ( it == placements.end() )
+								continue;
+							for ( size_t dst_idx : it->second )
+							{
+								auto& list = dependents[ idx ];
+								if ( dst_idx > idx && std::find( list.begin(), list.end(), dst_idx ) == list.end() )
+									list.emplace_back( dst_idx );
+							}
+						}
+					}
 				}
+
+				// If a block is placed more than once, make sure the instances are serialized.
+				//
+				for ( auto& [block, list] : placements )
+					for ( size_t n = 1; n < list.size(); n++ )
+						dependents[ list[ n - 1 ] ].emplace_back( list[ n ] );
+
+				// Dispatch each block as soon as its dependencies are processed.
+				//
+				transform_parallel_graph( dependents, [ & ] ( size_t idx )
+				{
+					worker( make_mutable( entries[ idx ].block ) );
+				} );
 				break;
 			}
 			default: 
@@ -266,8 +350,10 @@ namespace vtil::optimizer
 		}
 		size_t xpass( routine* rtn ) override
 		{
+			profile_span _p{ "conditional_pass", "pass" };
 			size_t n = T1{}.xpass( rtn );
 			if ( n ) n += combine_pass<Tx...>{}.xpass( rtn );
+			_p.args = { { "optimizations", n } };
 			return n;
 		}
 		std::string name() override { return "conditional{" + T1{}.name() + " => " + combine_pass<Tx...>{}.name() + "}"; }
@@ -278,20 +364,108 @@ namespace vtil::optimizer
 	template<typename... Tx>
 	struct exhaust_pass : pass_interface<execution_order::custom>
 	{
-		// Simple looping until pass returns 0.
+		// Simple looping until pass returns 0 or the budget is exhausted.
 		//
 		size_t pass( basic_block* blk, bool xblock = false ) override
 		{ 
 			size_t cnt = 0;
-			while ( size_t n = combine_pass<Tx...>{}.pass( blk, xblock ) )
+			optimization_budget* budget = *impl::active_budget;
+			while ( !budget || budget->check() )
+			{
+				size_t n = combine_pass<Tx...>{}.pass( blk, xblock );
+				if ( !n ) break;
 				cnt += n;
+			}
 			return cnt;
 		}
 		size_t xpass( routine* rtn ) override
 		{
 			size_t cnt = 0;
-			while ( size_t n = combine_pass<Tx...>{}.xpass( rtn ) )
-				cnt += n;
+			profile_span _p{ "exhaust_pass", "pass" };
+			optimization_budget* budget = *impl::active_budget;
+			if constexpr ( !VTIL_OPT_INCREMENTAL_EXHAUST )
+			{
+				while ( !budget || budget->consume_iteration() )
+				{
+					profile_span _i{ "iteration", "pass" };
+					size_t n = combine_pass<Tx...>{}.xpass( rtn );
+					if ( !n ) break;
+					cnt += n;
+				}
+			}
+			else
+			{
+				// Current worklist, if null all blocks in the inherited restriction are visited.
+				//
+				const path_set* inherited = *impl::block_worklist;
+				path_set worklist;
+				bool full = true;
+
+				std::unordered_map<const basic_block*, epoch_t, hasher<>> epochs;
+				while ( !budget || budget->consume_iteration() )
+				{
+					// Save the state of the routine.
+					//
+					epochs.clear();
+					epochs.reserve( rtn->num_blocks() );
+					for ( auto& [vip, blk] : rtn->explored_blocks )
+						epochs.emplace( blk, blk->epoch );
+					epoch_t cfg_epoch = rtn->cfg_epoch;
+
+					// Run the passes on the worklist.
+					//
+					size_t n;
+					{
+						profile_span _i{ "iteration", "pass" };
+						scope_block_worklist _w{ full ? inherited : &worklist };
+						n = combine_pass<Tx...>{}.xpass( rtn );
+						_i.args = { { "blocks", full ? rtn->num_blocks() : worklist.size() }, { "optimizations", n } };
+					}
+					cnt += n;
+
+					// If no changes were made, stop if this was a full iteration, 
+					// otherwise confirm the fixed-point with one.
+					//
+					if ( !n )
+					{
+						if ( full ) break;
+						full = true;
+						continue;
+					}
+
+					// If the control flow graph changed, we cannot trust the
+					// neighbour information, do a full iteration.
+					//
+					if ( rtn->cfg_epoch != cfg_epoch || rtn->num_blocks() != epochs.size() )
+					{
+						full = true;
+						continue;
+					}
+
+					// Schedule every modified block and its neighbours, staying within the inherited 
+					// restriction if any.
+					//
+					auto schedule = [ & ] ( const basic_block* blk )
+					{
+						if ( !inherited || inherited->contains( blk ) )
+							worklist.emplace( blk );
+					};
+					worklist.clear();
+					for ( auto& [vip, blk] : rtn->explored_blocks )
+					{
+						auto it = epochs.find( blk );
+						if ( it != epochs.end() && it->second == blk->epoch )
+							continue;
+						schedule( blk );
+						for ( auto* prev : blk->prev )
+							schedule( prev );
+						for ( auto* next : blk->next )
+							schedule( next );
+					}
+					full = worklist.empty();
+				}
+			}
+			_p.args = { { "optimizations", cnt } };
 			return cnt;
 		}
 		std::string name() override { return "exhaust{" + combine_pass<Tx...>{}.name() + "}"; }
@@ -372,13 +546,22 @@ namespace vtil::optimizer
 		std::string name() override { return T{}.name(); }
 	};
 
-	// Used to profile the pass.
+	// Used to profile the pass, records the timings into the active profiling sink
+	// if there is one, otherwise logs them.
 	//
 	template<typename T>
 	struct profile_pass : T
 	{
 		size_t pass( basic_block* blk, bool xblock = false ) override
 		{
+			if ( auto sink = impl::active_profile_sink.load( std::memory_order_relaxed ) )
+			{
+				timestamp_t t0 = time::now();
+				size_t cnt = T::pass( blk, xblock );
+				sink->add_span( T{}.name(), "block", t0, { { "block", blk->entry_vip }, { "optimizations", cnt } } );
+				return cnt;
+			}
+
 			if ( !xblock )
 				logger::log( "Block %08x => %-64s |", blk->entry_vip, T{}.name() );
 
@@ -390,6 +573,15 @@ namespace vtil::optimizer
 
 		size_t xpass( routine* rtn ) override
 		{
+			if ( auto sink = impl::active_profile_sink.load( std::memory_order_relaxed ) )
+			{
+				timestamp_t t0 = time::now();
+				size_t cnt = T::xpass( rtn );
+				sink->add_span( T{}.name(), "pass", t0, { { "optimizations", cnt } } );
+				sink->add_optimizations( cnt );
+				return cnt;
+			}
+
 			logger::log( "Routine => %-64s            |", T{}.name() );
 			auto [cnt, time] = profile( [ & ] () { return T::xpass( rtn ); } );
 			logger::log( " Took %-10s (N=%d).\n", time, cnt );
@@ -0,0 +1,177 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of VTIL Project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software 
+//    without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <vtil/utility>
+#include <vtil/io>
+
+namespace vtil::optimizer
+{
+	// Profiling sink collecting the timings of the passes as spans, can be written in 
+	// the Chrome trace-event format to be inspected in a flame view. Passes wrapped by
+	// profile_pass record into the installed sink instead of logging, e.g.:
+	// - profile_sink sink;
+	// - { scope_profile_sink _s{ &sink }; apply_all_profiled( rtn ); }
+	// - sink.write_chrome_trace( out );
+	//
+	struct profile_sink
+	{
+		// Single trace event, either a span or a counter.
+		//
+		struct event
+		{
+			std::string name;
+			const char* category;
+			bool is_counter;
+			uint32_t thread_id;
+			timeunit_t begin;
+			timeunit_t duration;
+			std::vector<std::pair<const char*, uint64_t>> args;
+		};
+
+		std::mutex lock;
+		std::vector<event> events;
+		timestamp_t origin = time::now();
+
+		// Total number of optimizations recorded.
+		//
+		std::atomic<uint64_t> optimization_count = { 0 };
+
+		// Returns a small unique identifier for the current thread.
+		//
+		static uint32_t thread_id()
+		{
+			static std::atomic<uint32_t> counter = { 0 };
+			static thread_local uint32_t id = counter++;
+			return id;
+		}
+
+		// Records a span that started at the given time and ended now.
+		//
+		void add_span( std::string name, const char* category, timestamp_t begin, std::vector<std::pair<const char*, uint64_t>> args = {} )
+		{
+			timestamp_t end = time::now();
+			std::lock_guard _g{ lock };
+			events.push_back( { std::move( name ), category, false, thread_id(), begin - origin, end - begin, std::move( args ) } );
+		}
+
+		// Records a counter value.
+		//
+		void add_counter( std::string name, const char* series, uint64_t value )
+		{
+			timestamp_t now = time::now();
+			std::lock_guard _g{ lock };
+			events.push_back( { std::move( name ), "counter", true, thread_id(), now - origin, {}, { { series, value } } } );
+		}
+
+		// Records the number of optimizations applied by a pass.
+		//
+		void add_optimizations( size_t n )
+		{
+			add_counter( "optimizations", "total", optimization_count += n );
+		}
+
+		// Writes the events in the Chrome trace-event JSON format.
+		//
+		void write_chrome_trace( std::ostream& out )
+		{
+			auto escape = [ ] ( std::string_view in )
+			{
+				std::string result;
+				result.reserve( in.size() );
+				for ( char c : in )
+				{
+					if ( c == '"' || c == '\\' )
+						result += '\\';
+					if ( uint8_t( c ) < 0x20 )
+						result += format::str( "\\u%04x", c );
+					else
+						result += c;
+				}
+				return result;
+			};
+
+			std::lock_guard _g{ lock };
+			out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+			for ( auto [evt, idx] : zip( events, iindices ) )
+			{
+				out << ( idx ? ",\n" : "\n" );
+				out << format::str( "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":0,\"tid\":%u,\"ts\":%.3lf",
+									escape( evt.name ), evt.category, evt.is_counter ? 'C' : 'X', evt.thread_id, evt.begin.count() / 1000.0 );
+				if ( !evt.is_counter )
+					out << format::str( ",\"dur\":%.3lf", evt.duration.count() / 1000.0 );
+				out << ",\"args\":{";
+				for ( auto [arg, aidx] : zip( evt.args, iindices ) )
+					out << format::str( "%s\"%s\":%llu", aidx ? "," : "", arg.first, arg.second );
+				out << "}}";
+			}
+			out << "\n]}\n";
+		}
+	};
+
+	namespace impl
+	{
+		// Currently installed profiling sink, if any.
+		//
+		inline std::atomic<profile_sink*> active_profile_sink = nullptr;
+	};
+
+	// RAII helper installing a profiling sink process-wide, null removes it.
+	//
+	struct scope_profile_sink
+	{
+		profile_sink* prev;
+		scope_profile_sink( profile_sink* sink ) : prev( impl::active_profile_sink.exchange( sink ) ) {}
+		~scope_profile_sink() { impl::active_profile_sink = prev; }
+	};
+
+	// RAII helper recording a span into the active sink if there is one.
+	//
+	struct profile_span
+	{
+		profile_sink* sink;
+		const char* name;
+		const char* category;
+		timestamp_t begin = {};
+		std::vector<std::pair<const char*, uint64_t>> args;
+
+		profile_span( const char* name, const char* category )
+			: sink( impl::active_profile_sink.load( std::memory_order_relaxed ) ), name( name ), category( category )
+		{
+			if ( sink ) begin = time::now();
+		}
+		~profile_span()
+		{
+			if ( sink ) sink->add_span( name, category, begin, std::move( args ) );
+		}
+	};
+};
@@ -48,10 +48,10 @@ namespace vtil::optimizer
 		//
 		cached_tracer local_tracer = {};
 		auto lbranch_info = aux::analyze_branch( blk, &local_tracer, {} );
-		ctracer.mtx.lock();
-		for ( auto& [k, v] : local_tracer.cache )
-			ctracer.cache[ k ] = v;
-		ctracer.mtx.unlock();
+		local_tracer.enumerate( [ & ] ( const symbolic::variable& k, const symbolic::expression::reference& v )
+		{
+			ctracer.insert( k, v );
+		} );
 		auto branch_info = aux::analyze_branch( blk, &ctracer, { .cross_block = true, .pack = true, .resolve_opaque = true } );
 
 		// If branching to real, assert single next block.
@@ -126,24 +126,23 @@ namespace vtil::optimizer
 				{
 					// Iterate cache entries:
 					//
-					std::shared_lock _g{ tr->mtx };
-					for ( auto& [var, ex] : tr->cache )
+					tr->enumerate( [ & ] ( const symbolic::variable& var, const symbolic::expression::reference& ex )
 					{
 						// Skip if memory variable or has invalid iterator.
 						//
 						if ( var.is_memory() || !var.at.is_valid() )
-							continue;
+							return enumerator::ocontinue;
 
 						// If expressions are not identical skip.
 						//
 						if ( !ex->is_identical( *exp ) )
-							continue;
+							return enumerator::ocontinue;
 
 						// Set var_reg and break.
 						//
 						var_reg = var;
-						break;
-					}
+						return enumerator::obreak;
+					} );
 				}
 				else
 				{
@@ -173,7 +172,7 @@ namespace vtil::optimizer
 				for ( auto [out, blocal, bglobal] : zip( dsts, lbranch_info.destinations, branch_info.destinations ) )
 				{
 					deferred_operand op;
-					if ( blocal->complexity <= bglobal->complexity )
+					if ( blocal->complexity() <= bglobal->complexity() )
 						op = revive_via_cache( blocal, &local_tracer );
 					else
 						op = revive_via_cache( bglobal, &ctracer );
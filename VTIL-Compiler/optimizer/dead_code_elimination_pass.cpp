@@ -93,8 +93,10 @@ namespace vtil::optimizer
 			if ( !used )
 			{
 				// Set to nop, will be invalid instruction, but can be atomically assigned.
+				// Block is not signalled until the instruction is erased so that the entries 
+				// traced for this block stay valid for the rest of the iteration.
 				//
-				( +it )->base = &ins::nop;
+				make_mutable( *it ).base = &ins::nop;
 				delete_list.emplace_back( it );
 			}
 		}
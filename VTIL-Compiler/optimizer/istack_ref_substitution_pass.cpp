@@ -52,12 +52,14 @@ namespace vtil::optimizer
 				//
 				auto delta = ctrace( { it, it->memory_location().first } ) - ctrace( { it, REG_SP } );
 
-				// If successful, replace the operands.
+				// If successful, replace the operands, block is signalled once all instructions
+				// are processed so that the entries traced for this block stay valid.
 				//
 				if ( auto stack_offset = delta.get<int64_t>() )
 				{
-					( +it )->operands[ it->base->memory_operand_index ] = { REG_SP };
-					( +it )->operands[ it->base->memory_operand_index + 1 ].imm().i64 += *stack_offset;
+					instruction& ins = make_mutable( *it );
+					ins.operands[ ins.base->memory_operand_index ] = { REG_SP };
+					ins.operands[ ins.base->memory_operand_index + 1 ].imm().i64 += *stack_offset;
 
 					// Validate modification and increment counter.
 					//
@@ -66,6 +68,8 @@ namespace vtil::optimizer
 				}
 			}
 		}
+		if ( counter )
+			blk->signal_modification();
 		return counter;
 	}
 }
@@ -114,9 +114,9 @@ namespace vtil::optimizer
 			if ( it->is_volatile() )
 				continue;
 
-			// Enumerate each operand:
+			// Enumerate each operand, block is signalled once the operands are swapped.
 			//
-			for ( auto [op, type] : ( +it )->enum_operands() )
+			for ( auto [op, type] : make_mutable( *it ).enum_operands() )
 			{
 				// Skip if being written to or if immediate.
 				//
@@ -190,6 +190,8 @@ namespace vtil::optimizer
 			*dst = op;
 			fassert( dst->is_valid() );
 		}
+		if ( !operand_swap_buffer.empty() )
+			blk->signal_modification();
 		return operand_swap_buffer.size();
 	}
 };
@@ -82,8 +82,11 @@ namespace vtil::optimizer
 			std::vector<instruction> instruction_buffer;
 			batch_translator translator = { &temporary_block };
 
-			// For each register state:
+			// Collect the written register values followed by the memory values and simplify them
+			// as a batch since they share most of their subtrees.
 			//
+			std::vector<register_desc> register_keys;
+			std::vector<symbolic::expression::reference> values;
 			for ( auto& pair : vm.register_state )
 			{
 				// Skip if not written, else collapse value.
@@ -93,9 +96,23 @@ namespace vtil::optimizer
 				if ( msb == -1 ) continue;
 				bitcnt_t size = pair.second.linear_store[ msb ].size() + msb;
 
-				register_desc k = { pair.first, size };
-				auto v = vm.read_register( k ).simplify();
+				register_keys.push_back( { pair.first, size } );
+				values.push_back( vm.read_register( register_keys.back() ) );
+			}
+			for ( auto& [k, v] : vm.memory_state )
+				values.push_back( v );
+			symbolic::simplify_expressions( values );
 
+			// Write the simplified memory values back.
+			//
+			auto value_it = values.begin() + register_keys.size();
+			for ( auto& [k, v] : vm.memory_state )
+				v = std::move( *value_it++ );
+
+			// For each register state:
+			//
+			for ( auto [k, v] : zip( register_keys, values ) )
+			{
 				// If value is unchanged, skip.
 				//
 				symbolic::expression v0 = symbolic::CTX( vm.reference_iterator )[ k ];
@@ -171,7 +188,6 @@ namespace vtil::optimizer
 			//
 			for ( auto& [k, v] : vm.memory_state )
 			{
-				v.simplify();
 				symbolic::expression v0 = symbolic::MEMORY( k, v.size() );
 
 				// If value is unchanged, skip.
@@ -29,6 +29,22 @@
 
 namespace vtil::symbolic::directive
 {
+	// Calculates the signature of the directive when matched against an expression of the given size.
+	//
+	expression_signature instance::signature_for( bitcnt_t size ) const
+	{
+		// Constants are resized, variables can match anything.
+		//
+		if ( op == math::operator_id::invalid )
+			return id ? expression_signature{} : expression_signature{ make_copy( value ).resize( size ) };
+
+		// Unary and binary operators.
+		//
+		if ( !lhs )
+			return { op, rhs->signature_for( size ) };
+		return { lhs->signature_for( size ), op, rhs->signature_for( size ) };
+	}
+
 	// Enumerates each unique variable.
 	//
 	void instance::enum_variables( const function_view<void( const instance& )>& fn, std::unordered_set<const char*>* s ) const
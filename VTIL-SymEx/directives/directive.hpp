@@ -206,10 +206,6 @@ namespace vtil::symbolic::directive
         //
         size_t num_nodes = 0;
 
-        // Signature of the directive for each possible size.
-        //
-        std::array<expression_signature, 64> signatures = {};
-
         // Default/copy/move constructors.
         //
         instance() {};
@@ -221,11 +217,7 @@ namespace vtil::symbolic::directive
         // Variable constructor.
         //
         template<Integral T = uint64_t>
-        instance( T v, bitcnt_t _discarded_bit_count = 0 ) : operable( ( int64_t ) v , 64 ), num_nodes( 1 )
-        {
-            for ( auto [out, idx] : zip( signatures, iindices ) )
-                out = { make_copy( value ).resize( math::narrow_cast<bitcnt_t>( idx + 1 ) ) };
-        }
+        instance( T v, bitcnt_t _discarded_bit_count = 0 ) : operable( ( int64_t ) v , 64 ), num_nodes( 1 ) {}
         instance( const char* id, int lookup_index, matching_type mtype = match_any ) : 
             id( id ), lookup_index( lookup_index ), mtype( mtype ), num_nodes( 1 ) {}
 
@@ -234,9 +226,6 @@ namespace vtil::symbolic::directive
         instance( math::operator_id op, const instance& e1 ) :
             rhs( e1 ), op( op ), num_nodes( e1.num_nodes + 1 )
         {
-            for ( auto [out, rhs] : zip( signatures, e1.signatures ) )
-                out = { op, rhs };
-
             if ( op == ( math::operator_id ) directive_op_desc::simplify )
                 priority = num_nodes;
             else if ( op == ( math::operator_id )  directive_op_desc::try_simplify )
@@ -250,15 +239,16 @@ namespace vtil::symbolic::directive
         instance( const instance& e1, math::operator_id op, const instance& e2 ) :
             lhs( e1 ), rhs( e2 ), op( op ), num_nodes( e1.num_nodes + e2.num_nodes + 1 )
         {
-            for ( auto [lhs, out, rhs] : zip( e1.signatures, signatures, e2.signatures ) )
-                out = { lhs, op, rhs };
-
             if ( op == ( math::operator_id ) directive_op_desc::iff )
                 priority = num_nodes;
             else
                 priority = std::max( lhs->priority, rhs->priority );
         }
 
+        // Calculates the signature of the directive when matched against an expression of the given size.
+        //
+        expression_signature signature_for( bitcnt_t size ) const;
+
         // Enumerates each unique variable.
         //
         void enum_variables( const function_view<void( const instance& )>& fn, std::unordered_set<const char*>* s = nullptr ) const;
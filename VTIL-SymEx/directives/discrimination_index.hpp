@@ -0,0 +1,272 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of VTIL Project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software 
+//    without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <vector>
+#include <bitset>
+#include <bit>
+#include "directive.hpp"
+#include "../expressions/expression.hpp"
+
+namespace vtil::symbolic::directive
+{
+	// Compiled form of an ordered list of directives sharing the same root operator.
+	//
+	// Each expression is classified by the "kind" of the nodes at the first two levels 
+	// below the root, where kind is either the operator or one of constant, variable, 
+	// absent and folded; the last one being an expression with a known value, which every 
+	// directive accepts since fast_match treats it as a constant. For each position and 
+	// kind, a bitmap of the directives that could match a node of that kind at that 
+	// position is precomputed, so that a single walk of the expression reduces the list 
+	// to the intersection of six bitmaps while preserving the original order. Candidates 
+	// are then filtered by the signatures of the directives, which are calculated once 
+	// for each size and stored contiguously. The result is a superset of the directives 
+	// that will match, fast_match is still responsible for the exact check.
+	//
+	struct discrimination_index
+	{
+		using entry_type = std::pair<const instance*, const instance*>;
+
+		// Kinds and positions.
+		//
+		static constexpr size_t kind_constant = ( size_t ) math::operator_id::max;
+		static constexpr size_t kind_variable = kind_constant + 1;
+		static constexpr size_t kind_absent =   kind_variable + 1;
+		static constexpr size_t kind_folded =   kind_absent + 1;
+		static constexpr size_t kind_count =    kind_folded + 1;
+		static constexpr size_t position_count = 6;
+		using kind_set = std::bitset<kind_count>;
+
+		// Ordered list of directives, the signatures indexed by [entry][size - 1] and the 
+		// bitmaps indexed by [position][kind][word].
+		//
+		std::vector<entry_type> entries;
+		std::vector<std::array<expression_signature, 64>> signatures;
+		size_t word_count = 0;
+		std::vector<uint64_t> bitmaps;
+
+		// List of candidates, iterable in the original order.
+		//
+		struct candidate_list
+		{
+			const discrimination_index* index;
+			stack_vector<uint64_t, 16> words;
+
+			struct iterator
+			{
+				const candidate_list* list;
+				size_t word;
+				uint64_t rest;
+
+				// Skips to the next set bit.
+				//
+				void settle()
+				{
+					while ( !rest && word < list->words.size() )
+						if ( ++word < list->words.size() )
+							rest = list->words[ word ];
+				}
+
+				const entry_type& operator*() const { return list->index->entries[ word * 64 + std::countr_zero( rest ) ]; }
+				iterator& operator++() { rest &= rest - 1; settle(); return *this; }
+				bool operator!=( const iterator& o ) const { return word != o.word || rest != o.rest; }
+				bool operator==( const iterator& o ) const { return !operator!=( o ); }
+			};
+
+			iterator begin() const 
+			{ 
+				iterator it = { this, 0, words.empty() ? 0 : words[ 0 ] };
+				it.settle();
+				return it;
+			}
+			iterator end() const { return { this, words.size(), 0 }; }
+		};
+
+		// Returns the kind of the node.
+		//
+		static size_t kind_of( const expression::reference& ref )
+		{
+			if ( !ref )                 return kind_absent;
+			if ( ref->is_expression() ) return ref->is_constant() ? kind_folded : ( size_t ) ref->op;
+			if ( ref->is_variable() )   return kind_variable;
+			return kind_constant;
+		}
+
+		// Returns the set of kinds the directive node can match.
+		//
+		static kind_set accepted_kinds( const instance* dir )
+		{
+			kind_set result = kind_set{}.set( kind_folded );
+			if ( !dir )
+				return result.set();
+
+			// If operator, must have the same operator.
+			//
+			if ( dir->op != math::operator_id::invalid )
+				return result.set( ( size_t ) dir->op );
+
+			// If constant, must be a constant.
+			//
+			if ( !dir->id )
+				return result.set( kind_constant );
+
+			// If variable, determine by the matching type.
+			//
+			kind_set expressions = result;
+			for ( size_t op = ( size_t ) math::operator_id::invalid + 1; op != ( size_t ) math::operator_id::max; op++ )
+				expressions.set( op );
+			switch ( dir->mtype )
+			{
+				case match_any:            return result.set();
+				case match_variable:       return result.set( kind_variable );
+				case match_constant:       return result.set( kind_constant );
+				case match_expression:     return expressions;
+				case match_non_expression: return result.set( kind_variable ).set( kind_constant );
+				case match_non_constant:   return expressions.set( kind_variable );
+				default:                   unreachable();
+			}
+			return result;
+		}
+
+		// Fills the sets of kinds the operands of the directive node can match, if the operator 
+		// is commutative either operand may end up at either position.
+		//
+		static void accepted_operand_kinds( const instance* dir, kind_set& lhs, kind_set& rhs )
+		{
+			if ( !dir || dir->op == math::operator_id::invalid )
+			{
+				lhs.set();
+				rhs.set();
+				return;
+			}
+
+			lhs = accepted_kinds( dir->lhs );
+			rhs = accepted_kinds( dir->rhs );
+			if ( math::descriptor_of( dir->op ).is_commutative )
+				lhs = rhs = lhs | rhs;
+		}
+
+		// Compiles the given list of directives.
+		//
+		discrimination_index() = default;
+		discrimination_index( std::vector<entry_type> list ) : entries( std::move( list ) )
+		{
+			word_count = ( entries.size() + 63 ) / 64;
+			bitmaps.resize( position_count * kind_count * word_count );
+			signatures.resize( entries.size() );
+
+			for ( size_t i = 0; i != entries.size(); i++ )
+			{
+				const instance* dir = entries[ i ].first;
+				for ( auto [out, idx] : zip( signatures[ i ], iindices ) )
+					out = dir->signature_for( math::narrow_cast<bitcnt_t>( idx + 1 ) );
+
+				std::array<kind_set, position_count> accepted;
+				accepted[ 0 ] = accepted_kinds( dir->lhs );
+				accepted[ 1 ] = accepted_kinds( dir->rhs );
+				accepted_operand_kinds( dir->lhs, accepted[ 2 ], accepted[ 3 ] );
+				accepted_operand_kinds( dir->rhs, accepted[ 4 ], accepted[ 5 ] );
+
+				for ( size_t pos = 0; pos != position_count; pos++ )
+					for ( size_t kind = 0; kind != kind_count; kind++ )
+						if ( accepted[ pos ].test( kind ) )
+							bitmaps[ ( pos * kind_count + kind ) * word_count + i / 64 ] |= 1ull << ( i % 64 );
+			}
+		}
+
+		// Returns the bitmap for the given position and kind.
+		//
+		const uint64_t* bitmap( size_t pos, size_t kind ) const { return &bitmaps[ ( pos * kind_count + kind ) * word_count ]; }
+
+		// Returns the list of directives that may match the given expression, which must 
+		// have the same root operator as the directives.
+		//
+		candidate_list match( const expression& exp ) const
+		{
+			candidate_list result = { this, {} };
+			result.words.resize( word_count );
+			if ( !word_count )
+				return result;
+
+			// Classify the nodes.
+			//
+			std::array<size_t, position_count> kinds;
+			kinds[ 0 ] = kind_of( exp.lhs );
+			kinds[ 1 ] = kind_of( exp.rhs );
+			kinds[ 2 ] = exp.lhs ? kind_of( exp.lhs->lhs ) : kind_absent;
+			kinds[ 3 ] = exp.lhs ? kind_of( exp.lhs->rhs ) : kind_absent;
+			kinds[ 4 ] = exp.rhs ? kind_of( exp.rhs->lhs ) : kind_absent;
+			kinds[ 5 ] = exp.rhs ? kind_of( exp.rhs->rhs ) : kind_absent;
+
+			// Intersect the bitmaps.
+			//
+			auto intersect = [ & ] ( const std::array<size_t, position_count>& kinds )
+			{
+				std::array<const uint64_t*, position_count> maps;
+				for ( size_t pos = 0; pos != position_count; pos++ )
+					maps[ pos ] = bitmap( pos, kinds[ pos ] );
+
+				for ( size_t w = 0; w != word_count; w++ )
+				{
+					uint64_t word = ~0ull;
+					for ( auto map : maps )
+						word &= map[ w ];
+					result.words[ w ] |= word;
+				}
+			};
+			intersect( kinds );
+
+			// If commutative, try the swapped form as well.
+			//
+			if ( exp.lhs && exp.get_op_desc().is_commutative )
+				intersect( { kinds[ 1 ], kinds[ 0 ], kinds[ 4 ], kinds[ 5 ], kinds[ 2 ], kinds[ 3 ] } );
+
+			// Filter by the signatures.
+			//
+			dassert( 0 < exp.size() && exp.size() <= 64 );
+			for ( size_t w = 0; w != word_count; w++ )
+			{
+				for ( uint64_t rest = result.words[ w ]; rest; rest &= rest - 1 )
+				{
+					size_t i = w * 64 + std::countr_zero( rest );
+					if ( !exp.signature().can_match( signatures[ i ][ exp.size() - 1 ] ) )
+						result.words[ w ] &= ~( 1ull << ( i % 64 ) );
+				}
+			}
+			return result;
+		}
+		candidate_list match( const expression::reference& exp ) const { return match( *exp ); }
+		candidate_list match( const expression::weak_reference& exp ) const { return match( *exp ); }
+
+		// Basic container interface.
+		//
+		auto begin() const { return entries.begin(); }
+		auto end() const { return entries.end(); }
+		size_t size() const { return entries.size(); }
+		bool empty() const { return entries.empty(); }
+	};
+};
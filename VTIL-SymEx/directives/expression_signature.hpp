@@ -48,7 +48,7 @@ namespace vtil::symbolic
 		
 		// Declare constructors.
 		//
-		expression_signature() {}
+		expression_signature() : signature{}, hash_value{} {}
 		expression_signature( const math::bit_vector& value );
 		expression_signature( math::operator_id op, const expression_signature& rhs );
 		expression_signature( const expression_signature& lhs, math::operator_id op, const expression_signature& rhs );
@@ -171,12 +171,13 @@ namespace vtil::symbolic
 			{
 				static constexpr auto expected = make_expanded_series<VTIL_SYMEX_XVAL_KEYS>( [ ] ( auto ) { return 1ull; } );
 
-				// Translate left hand side, if failed to do so or is not equal to [true], fail.
+				// Translate left hand side, if failed to do so or is not equal to [true], fail. If the known
+				// bits and the range of the condition already determine its value, skip the simplifier.
 				//
 				auto condition_status = translate( sym, dir->lhs, 0 );
 				if ( !condition_status ||
 					 memcmp( condition_status->xvalues().data(), expected.data(), expected.size() * sizeof( expected[ 0 ] ) ) ||
-					 !condition_status.simplify()->get().value_or( false ) )
+					 !( condition_status->is_constant() ? condition_status->get() : condition_status.simplify()->get() ).value_or( false ) )
 				{
 #if VTIL_SYMEX_SIMPLIFY_VERBOSE
 					log<CON_RED>( "Rejected %s, condition (%s) not met.\n", *dir->rhs, *dir->lhs );
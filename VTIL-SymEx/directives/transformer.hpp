@@ -40,7 +40,8 @@ namespace vtil::symbolic
                                      bitcnt_t bit_cnt );
 
 	// Attempts to transform the expression in form A to form B as indicated by the directives, 
-	// and returns the first instance that matches query.
+	// and returns the first instance that matches query. Signature based pre-filtering is left
+	// to the caller, see directive::discrimination_index.
 	//
 	template<typename... Tx>
 	static expression::reference transform( expression::weak_reference exp,
@@ -49,12 +50,6 @@ namespace vtil::symbolic
 	{
 		using namespace logger;
 
-		// Fast path: check if signature matches.
-		//
-		dassert( 0 < exp->size() && exp->size() <= 64 );
-		if ( !exp->signature.can_match( from->signatures[ exp->size() - 1 ] ) )
-			return {};
-
 		// Match the expresison.
 		//
 		stack_vector<directive::symbol_table_t, 8> results;
@@ -113,7 +108,7 @@ namespace vtil::symbolic
 #if VTIL_SYMEX_SIMPLIFY_VERBOSE
 				// Log state.
 				//
-				log<CON_RED>( "Rejected by filter (Complexity: %lf vs %lf).\n", exp_new->complexity, exp->complexity );
+				log<CON_RED>( "Rejected by filter (Complexity: %lf vs %lf).\n", exp_new->complexity(), exp->complexity() );
 #endif
 			}
 #if VTIL_SYMEX_SIMPLIFY_VERBOSE
@@ -27,10 +27,157 @@
 //
 #include "expression.hpp"
 #include <vtil/io>
+#include <mutex>
+#include <unordered_map>
 #include "../simplifier/simplifier.hpp"
 
+// [Configuration]
+// Determine the number of shards the intern table is split into and the number of
+// entries a shard can grow to before it is swept for unreferenced nodes.
+//
+#ifndef VTIL_SYMEX_INTERN_SHARDS
+	#define VTIL_SYMEX_INTERN_SHARDS 64
+#endif
+#ifndef VTIL_SYMEX_INTERN_SWEEP_THRESHOLD
+	#define VTIL_SYMEX_INTERN_SWEEP_THRESHOLD 0x4000
+#endif
+
 namespace vtil::symbolic
 {
+	// Global table of canonical expression nodes.
+	//
+	struct intern_table
+	{
+		struct shard
+		{
+			std::mutex lock;
+			std::unordered_multimap<hash_t, expression::reference> entries;
+			size_t sweep_threshold = VTIL_SYMEX_INTERN_SWEEP_THRESHOLD;
+		};
+		shard shards[ VTIL_SYMEX_INTERN_SHARDS ];
+		std::atomic<uint64_t> next_id = { 1 };
+
+		// Since operands of the nodes being compared are already interned, whether or not they
+		// are identical can be checked by comparing the identifiers of the operands.
+		//
+		static bool is_same_class( const expression& a, const expression& b )
+		{
+			if ( a.hash() != b.hash() || a.op != b.op || a.size() != b.size() )
+				return false;
+			if ( !a.is_expression() )
+				return a.is_variable() ? ( b.is_variable() && a.uid == b.uid ) : ( b.is_constant() && a.value == b.value );
+
+			auto id = [ ] ( const expression::reference& ref ) -> uint64_t { return ref ? ref->intern_id : 0; };
+			if ( id( a.lhs ) == id( b.lhs ) && id( a.rhs ) == id( b.rhs ) )
+				return true;
+			return a.lhs && a.get_op_desc().is_commutative && id( a.lhs ) == id( b.rhs ) && id( a.rhs ) == id( b.lhs );
+		}
+
+		// Nodes in the same class are only shared if their operands are the same nodes as well 
+		// so that interning does not change the operand order of commutative operators.
+		//
+		static bool is_same_node( const expression& a, const expression& b )
+		{
+			return a.lhs.get() == b.lhs.get() && a.rhs.get() == b.rhs.get();
+		}
+
+		// Erases the entries that are only referenced by the table, returns the number of entries erased.
+		//
+		static size_t sweep( shard& sh )
+		{
+			size_t count = 0;
+			for ( auto it = sh.entries.begin(); it != sh.entries.end(); )
+			{
+				if ( expression::reference::get_ref( it->second.get_entry() ) == 1 )
+					it = sh.entries.erase( it ), count++;
+				else
+					++it;
+			}
+			return count;
+		}
+
+		// Finds or inserts the canonical instance of the given node.
+		//
+		expression::reference canonicalize( expression::reference&& ref )
+		{
+			hash_t hash = ref->hash();
+			shard& sh = shards[ hash % VTIL_SYMEX_INTERN_SHARDS ];
+			std::lock_guard _g{ sh.lock };
+
+			uint64_t id = 0;
+			auto [it, end] = sh.entries.equal_range( hash );
+			for ( ; it != end; ++it )
+			{
+				if ( is_same_class( *it->second, *ref ) )
+				{
+					if ( is_same_node( *it->second, *ref ) )
+						return it->second;
+					id = it->second->intern_id;
+				}
+			}
+
+			// Sweep the shard if it grew past its threshold, raise the threshold if most entries are still alive.
+			//
+			if ( sh.entries.size() >= sh.sweep_threshold && sweep( sh ) < ( sh.sweep_threshold / 2 ) )
+				sh.sweep_threshold *= 2;
+
+			( +ref )->intern_id.value = id ? id : next_id++;
+			return sh.entries.emplace( hash, std::move( ref ) )->second;
+		}
+
+		// Purges every shard.
+		//
+		size_t purge()
+		{
+			// Releasing a node may release the last outside reference to its operands, so repeat until stable.
+			//
+			size_t count = 0, n;
+			do
+			{
+				n = 0;
+				for ( auto& sh : shards )
+				{
+					std::lock_guard _g{ sh.lock };
+					n += sweep( sh );
+					sh.sweep_threshold = VTIL_SYMEX_INTERN_SWEEP_THRESHOLD;
+				}
+				count += n;
+			}
+			while ( n );
+			return count;
+		}
+
+		// Returns the number of entries.
+		//
+		size_t size()
+		{
+			size_t count = 0;
+			for ( auto& sh : shards )
+			{
+				std::lock_guard _g{ sh.lock };
+				count += sh.entries.size();
+			}
+			return count;
+		}
+
+		// Intentionally leaked to avoid destruction order issues with expressions outliving the table.
+		//
+		static intern_table& get() { static intern_table* instance = new intern_table(); return *instance; }
+	};
+
+	// Enables or disables hash-consing of expression references.
+	//
+	void set_expression_interning( bool enabled ) { impl::expression_interning = enabled; }
+	bool is_expression_interning_enabled() { return impl::expression_interning; }
+
+	// Releases the interned expressions that are not referenced outside of the intern table.
+	//
+	size_t purge_interned_expressions() { return intern_table::get().purge(); }
+
+	// Returns the number of nodes in the intern table.
+	//
+	size_t get_interned_expression_count() { return intern_table::get().size(); }
+
 	// Returns the number of constants used in the expression.
 	//
 	size_t expression::count_constants() const
@@ -53,15 +200,14 @@ namespace vtil::symbolic
 
 	// Returns the number of unique variables used in the expression.
 	//
-	size_t expression::count_unique_variables( std::set<unique_identifier>* visited ) const
+	size_t expression::count_unique_variables( unique_identifier_set* visited ) const
 	{
-		std::set<unique_identifier> tmp;
+		unique_identifier_set tmp;
 		if ( !visited ) visited = &tmp;
 
-		if ( is_variable() && visited->find( uid ) == visited->end() )
+		if ( is_variable() )
 		{
-			visited->insert( uid );
-			return 1;
+			return visited->insert( *uid ) ? 1 : 0;
 		}
 		else
 		{
@@ -396,6 +542,10 @@ namespace vtil::symbolic
 	//
 	expression& expression::update( bool auto_simplify )
 	{
+		// Invalidate the fields computed on demand.
+		//
+		lazy_state.reset();
+
 		// Propagate lazyness.
 		//
 		if ( ( lhs && lhs->is_lazy ) ||
@@ -413,38 +563,10 @@ namespace vtil::symbolic
 			//
 			depth = 0;
 
-			// If constant value:
+			// Calculate the x values and the range.
 			//
-			if ( is_constant() )
-			{
-				// Punish for each set bit in [min_{msb x + popcnt x}(v, |v|)], in an exponentially decreasing rate.
-				//
-				int64_t cval = *value.get<true>();
-				complexity = sqrt( 1 + std::min( math::msb( cval ) + math::popcnt( cval ), 
-								                 math::msb( abs( cval ) ) + math::popcnt( abs( cval ) ) ) );
-
-				// Hash is made up of the bit vector masks and the number of bits.
-				//
-				hash_value = make_hash( value.known_zero(), value.known_one(), ( uint8_t ) value.size() );
-			}
-			// If symbolic variable:
-			//
-			else
-			{
-				dassert( is_variable() );
-
-				// Assign the constant complexity value.
-				//
-				complexity = 128;
-
-				// Hash is made up of UID's hash and the number of bits.
-				//
-				hash_value = make_hash( uid.hash(), ( uint8_t ) value.size() );
-			}
-
-			// Set the signature.
-			//
-			signature = { value };
+			update_xvalues();
+			range = math::value_range::from_bits( value );
 
 			// Set simplification state.
 			//
@@ -477,15 +599,9 @@ namespace vtil::symbolic
 					return update( false );
 				}
 
-				// Calculate base complexity and the depth.
+				// Calculate the depth.
 				//
 				depth = rhs->depth + 1;
-				complexity = rhs->complexity * 2;
-				dassert( complexity != 0 );
-				
-				// Begin hash as rhs.
-				//
-				hash_value = rhs->hash();
 			}
 			// If binary operator:
 			//
@@ -608,45 +724,53 @@ namespace vtil::symbolic
 						break;
 				}
 
-				// Calculate base complexity and the depth.
+				// Calculate the depth.
 				//
 				depth = std::max( lhs->depth, rhs->depth ) + 1;
-				complexity = ( lhs->complexity + rhs->complexity ) * 2;
-				dassert( complexity != 0 );
-
-				// Multiply with operator complexity coefficient.
-				//
-				complexity *= desc.complexity_coeff;
-
-				// Begin hash as combine(op#1, op#2), make it unordered if operator is commutative.
-				//
-				hash_value = desc.is_commutative ? combine_unordered_hash( lhs->hash(), rhs->hash() ) : combine_hash( lhs->hash(), rhs->hash() );
 			}
 
-			// Set the signature.
+			// Calculate the range from the operands' ranges and use it to refine the known bits. Skipped if
+			// there is nothing to derive; for bitwise operators if the operands' ranges are no tighter than
+			// their known bits, otherwise if the operands are unbounded.
 			//
-			if( lhs ) signature = { lhs->signature, op, rhs->signature };
-			else      signature = {                 op, rhs->signature };
+			const auto is_tighter_than_bits = [ ] ( const reference& operand )
+			{
+				return operand->range.umin != operand->value.known_one() ||
+					   operand->range.umax != ( operand->value.known_one() | operand->value.unknown_mask() );
+			};
+			bool derive_range;
+			if ( desc.hint_bitwise == 1 )
+				derive_range = ( lhs && is_tighter_than_bits( lhs ) ) || is_tighter_than_bits( rhs );
+			else
+				derive_range = op == math::operator_id::cast ||
+							   ( lhs && !lhs->range.is_full( lhs->size() ) ) ||
+							   !rhs->range.is_full( rhs->size() );
 
-			// Append depth, size, and operator information to the hash.
-			//
-			hash_value = combine_hash( hash_value, make_hash( op, depth, uint8_t( value.size() ) ) );
+			range = math::value_range::from_bits( value );
+			if ( derive_range )
+			{
+				range = math::value_range::meet(
+					range,
+					math::evaluate_range( op, lhs ? lhs->size() : 0, lhs ? lhs->range : math::value_range{}, rhs->size(), rhs->range, value.size() ),
+					value.size()
+				);
+				value = range.refine( value );
+			}
 
-			// Punish for mixing bitwise and arithmetic operators.
+			// Speculative simplification, see [1].
 			//
-			for ( auto& operand : { &lhs, &rhs } )
+			if ( ( is_lazy || auto_simplify ) && value.is_known() )
 			{
-				if ( *operand && operand->get()->is_expression() )
-				{
-					// Bitwise hint of the descriptor contains +1 or -1 if the operator
-					// is strictly bitwise or arithmetic respectively and 0 otherwise.
-					// This works since mulitplication between them will only be negative
-					// if the hints mismatch.
-					//
-					complexity *= 1 + math::sgn( operand->get()->get_op_desc().hint_bitwise * desc.hint_bitwise );
-				}
+				lhs = {}; rhs = {};
+				op = math::operator_id::invalid;
+				is_lazy = false;
+				return update( false );
 			}
 
+			// Calculate the x values from the operands' x values.
+			//
+			update_xvalues();
+
 			// Reset simplification state since expression was updated.
 			//
 			simplify_hint = false;
@@ -669,6 +793,183 @@ namespace vtil::symbolic
 		return *this;
 	}
 
+	// Recalculates the x value cache, operands must be up-to-date.
+	//
+	void expression::update_xvalues()
+	{
+		static constexpr size_t N = VTIL_SYMEX_XVAL_KEYS;
+
+		// If binary operation:
+		//
+		if ( lhs )
+		{
+			// Mask the shift count for operators using it as such.
+			//
+			switch ( op )
+			{
+				case math::operator_id::shift_right:
+				case math::operator_id::shift_left:
+				case math::operator_id::rotate_right:
+				case math::operator_id::rotate_left:
+				case math::operator_id::bit_test:
+				{
+					if ( rhs->is_variable() )
+					{
+						std::array<uint64_t, N> xrhs = rhs->xvalue_cache;
+						for ( auto& v : xrhs )
+							v &= lhs->size() - 1;
+						math::evaluate_lanes<N>( op, lhs->size(), lhs->xvalue_cache.data(), rhs->size(), xrhs.data(), xvalue_cache.data() );
+						return;
+					}
+					break;
+				}
+				default:
+					break;
+			}
+
+			// Evalute based on lhs's and rhs's x values.
+			//
+			math::evaluate_lanes<N>( op, lhs->size(), lhs->xvalue_cache.data(), rhs->size(), rhs->xvalue_cache.data(), xvalue_cache.data() );
+		}
+		// If unary operation:
+		//
+		else if ( rhs )
+		{
+			// Evalute based on rhs's x values.
+			//
+			static constexpr std::array<uint64_t, N> zero = {};
+			math::evaluate_lanes<N>( op, 0, zero.data(), rhs->size(), rhs->xvalue_cache.data(), xvalue_cache.data() );
+		}
+		// If constant:
+		//
+		else if ( is_constant() )
+		{
+			// All x values are equivalent to the actual value.
+			//
+			xvalue_cache.fill( *value.get() );
+		}
+		// If variable:
+		//
+		else
+		{
+			dassert( is_variable() );
+			static constexpr auto keys = make_crandom_n<N>();
+
+			// Generate x values based on the hash.
+			//
+			hash_t hash_value = hash();
+			xvalue_cache[ 0 ] = ( hash_value & 64 ) & value.value_mask();
+			for ( size_t n = 1; n != N; n++ )
+				xvalue_cache[ n ] = ( hash_value ^ keys[ n ] ) & value.value_mask();
+		}
+	}
+
+	// Computes the hash on demand, operands' hashes are computed recursively if not already.
+	//
+	void expression::compute_hash() const
+	{
+		// If another thread is computing the hash already, wait for it instead.
+		//
+		if ( !lazy_state.claim( impl::lazy_hash ) )
+			return lazy_state.wait( impl::lazy_hash );
+
+		// If operation, begin hash as combine(op#1, op#2), make it unordered if operator is commutative
+		// and append depth, size, and operator information.
+		//
+		if ( is_expression() )
+		{
+			hash_t base;
+			if ( !lhs )                                  base = rhs->hash();
+			else if ( get_op_desc().is_commutative )     base = combine_unordered_hash( lhs->hash(), rhs->hash() );
+			else                                         base = combine_hash( lhs->hash(), rhs->hash() );
+			lazy_state.hash_value = combine_hash( base, make_hash( op, depth, uint8_t( value.size() ) ) );
+		}
+		// If constant, hash is made up of the bit vector masks and the number of bits.
+		//
+		else if ( is_constant() )
+		{
+			lazy_state.hash_value = make_hash( value.known_zero(), value.known_one(), ( uint8_t ) value.size() );
+		}
+		// If symbolic variable, hash is made up of UID's hash and the number of bits.
+		//
+		else
+		{
+			lazy_state.hash_value = make_hash( uid.hash(), ( uint8_t ) value.size() );
+		}
+		lazy_state.set( impl::lazy_hash );
+	}
+
+	// Computes the signature on demand.
+	//
+	void expression::compute_signature() const
+	{
+		// If another thread is computing the signature already, wait for it instead.
+		//
+		if ( !lazy_state.claim( impl::lazy_signature ) )
+			return lazy_state.wait( impl::lazy_signature );
+
+		if ( !is_expression() ) lazy_state.signature_value = { value };
+		else if ( lhs )         lazy_state.signature_value = { lhs->signature(), op, rhs->signature() };
+		else                    lazy_state.signature_value = {                   op, rhs->signature() };
+		lazy_state.set( impl::lazy_signature );
+	}
+
+	// Computes the complexity on demand.
+	//
+	void expression::compute_complexity() const
+	{
+		// If another thread is computing the complexity already, wait for it instead.
+		//
+		if ( !lazy_state.claim( impl::lazy_complexity ) )
+			return lazy_state.wait( impl::lazy_complexity );
+
+		// If operation:
+		//
+		if ( is_expression() )
+		{
+			// Calculate the base complexity, if binary multiply with operator complexity coefficient.
+			//
+			const math::operator_desc& desc = get_op_desc();
+			double result;
+			if ( lhs ) result = ( lhs->complexity() + rhs->complexity() ) * 2 * desc.complexity_coeff;
+			else       result = rhs->complexity() * 2;
+			dassert( result != 0 );
+
+			// Punish for mixing bitwise and arithmetic operators.
+			//
+			for ( auto& operand : { &lhs, &rhs } )
+			{
+				if ( *operand && operand->get()->is_expression() )
+				{
+					// Bitwise hint of the descriptor contains +1 or -1 if the operator
+					// is strictly bitwise or arithmetic respectively and 0 otherwise.
+					// This works since mulitplication between them will only be negative
+					// if the hints mismatch.
+					//
+					result *= 1 + math::sgn( operand->get()->get_op_desc().hint_bitwise * desc.hint_bitwise );
+				}
+			}
+			lazy_state.complexity_value = result;
+		}
+		// If constant value:
+		//
+		else if ( is_constant() )
+		{
+			// Punish for each set bit in [min_{msb x + popcnt x}(v, |v|)], in an exponentially decreasing rate.
+			//
+			int64_t cval = *value.get<true>();
+			lazy_state.complexity_value = sqrt( 1 + std::min( math::msb( cval ) + math::popcnt( cval ), 
+								                              math::msb( abs( cval ) ) + math::popcnt( abs( cval ) ) ) );
+		}
+		// If symbolic variable, assign the constant complexity value.
+		//
+		else
+		{
+			lazy_state.complexity_value = 128;
+		}
+		lazy_state.set( impl::lazy_complexity );
+	}
+
 	// Simplifies the expression.
 	//
 	expression& expression::simplify( bool prettify )
@@ -727,6 +1028,11 @@ namespace vtil::symbolic
 		};
 		constexpr auto cmp = is_identical_impl;
 
+		// If both nodes are interned, compare the identifiers.
+		//
+		if ( self.intern_id && other.intern_id )
+			return self.intern_id == other.intern_id;
+
 		// If hash/size mismatches, return false without checking anything.
 		//
 		if ( self.hash() != other.hash() || self.size() != other.size() )
@@ -843,7 +1149,7 @@ namespace vtil::symbolic
 
 		// Check if properties match.
 		//
-		if ( ( same_depth ? a->signature != b->signature : b->signature.can_match( a->signature ) ) || 
+		if ( ( same_depth ? a->signature() != b->signature() : b->signature().can_match( a->signature() ) ) || 
 			 ( same_depth ? a->depth != b->depth : a->depth > b->depth ) ||
 			 a->op != b->op ||
 			 a->size() != b->size() )
@@ -1002,6 +1308,34 @@ namespace vtil::symbolic
 		return std::move( make_copy( *this ).make_lazy() );
 	}
 
+	// Replaces the reference with the canonical instance of the expression from the intern table.
+	//
+	expression_reference& expression_reference::intern()
+	{
+		// Skip if null, temporary, lazy or already interned.
+		//
+		if ( !is_valid() || is_temporary() || get()->is_lazy || get()->intern_id )
+			return *this;
+
+		// Intern the operands first, skip if any of them cannot be interned.
+		//
+		for ( auto field : { &expression::lhs, &expression::rhs } )
+		{
+			const expression_reference& operand = get()->*field;
+			if ( !operand || operand->intern_id )
+				continue;
+			if ( operand.is_temporary() || operand->is_lazy )
+				return *this;
+			if ( !( own()->*field ).intern()->intern_id )
+				return *this;
+		}
+
+		// Swap with the canonical instance.
+		//
+		*this = intern_table::get().canonicalize( std::move( *this ) );
+		return *this;
+	}
+
 	// Forward declared redirects for internal use cases.
 	//
 	hash_t expression_reference::hash() const
@@ -29,15 +29,26 @@
 #include <vtil/math>
 #include <vtil/utility>
 #include <set>
+#include <atomic>
+#include <thread>
 #include "unique_identifier.hpp"
 #include "../directives/expression_signature.hpp"
 
 // [Configuration]
-// Determine the number of x value keys we use to estimate values.
+// Determine the number of x value keys we use to estimate values, each node caches this many 
+// 64-bit values so higher counts trade memory for fewer false positives in estimations.
 //
 #ifndef VTIL_SYMEX_XVAL_KEYS
 	#define VTIL_SYMEX_XVAL_KEYS 4
 #endif
+static_assert( 1 <= VTIL_SYMEX_XVAL_KEYS && VTIL_SYMEX_XVAL_KEYS <= 32, "Number of x value keys should be in range [1, 32]." );
+
+// Determine whether expression references are hash-consed by default, can be changed
+// at runtime with vtil::symbolic::set_expression_interning.
+//
+#ifndef VTIL_SYMEX_INTERN_EXPRESSIONS
+	#define VTIL_SYMEX_INTERN_EXPRESSIONS 0
+#endif
 
 // Allow expression::reference to be used with expression type directly as operable.
 //
@@ -48,6 +59,148 @@ namespace vtil::symbolic
 {
 	struct expression;
 
+	namespace impl
+	{
+		// Whether or not expression references are interned upon construction.
+		//
+		inline std::atomic<bool> expression_interning = { VTIL_SYMEX_INTERN_EXPRESSIONS != 0 };
+
+		// A value that is reset whenever the object holding it is copied or assigned to.
+		//
+		template<typename T>
+		struct transient
+		{
+			T value = {};
+
+			transient() = default;
+			transient( const transient& ) {}
+			transient& operator=( const transient& ) { value = {}; return *this; }
+			operator const T&() const { return value; }
+		};
+
+		// Fields of the expression computed on demand. Each field is written by the single thread
+		// that claims it, other threads wait for the claim to complete; the validity flag is set with
+		// release semantics after the field is written so readers never observe a partial value.
+		// Copies inherit the fields that were already computed, and only those are read.
+		//
+		enum lazy_field : uint8_t
+		{
+			lazy_hash =       1 << 0,
+			lazy_signature =  1 << 1,
+			lazy_complexity = 1 << 2,
+		};
+		static constexpr uint8_t lazy_valid_mask = lazy_hash | lazy_signature | lazy_complexity;
+		static constexpr uint8_t lazy_claim_shift = 4;
+
+		struct lazy_fields
+		{
+			// Validity flags in the low bits and claim flags in the high bits.
+			//
+			std::atomic<uint8_t> state = { 0 };
+
+			// Hash used by the simplifier cache, the signature, and the arbitrarily defined complexity
+			// value that is used as an inverse reward function in simplification.
+			//
+			hash_t hash_value = {};
+			expression_signature signature_value = {};
+			double complexity_value = 0;
+
+			lazy_fields() = default;
+			lazy_fields( const lazy_fields& o ) { *this = o; }
+			lazy_fields& operator=( const lazy_fields& o )
+			{
+				uint8_t valid = o.state.load( std::memory_order::acquire ) & lazy_valid_mask;
+				if ( valid & lazy_hash )       hash_value = o.hash_value;
+				if ( valid & lazy_signature )  signature_value = o.signature_value;
+				if ( valid & lazy_complexity ) complexity_value = o.complexity_value;
+				state.store( valid, std::memory_order::release );
+				return *this;
+			}
+
+			// Checks whether the field is computed.
+			//
+			bool test( lazy_field field ) const { return state.load( std::memory_order::acquire ) & field; }
+
+			// Claims the field for computation, returns false if it is computed or being computed by 
+			// another thread already, in which case ::wait should be used instead.
+			//
+			bool claim( lazy_field field ) 
+			{
+				uint8_t prev = state.fetch_or( uint8_t( field << lazy_claim_shift ), std::memory_order::acquire );
+				return !( prev & ( field | ( field << lazy_claim_shift ) ) );
+			}
+
+			// Publishes the claimed field or waits for it to be published.
+			//
+			void set( lazy_field field ) { state.fetch_or( field, std::memory_order::release ); }
+			void wait( lazy_field field ) const { while ( !test( field ) ) std::this_thread::yield(); }
+
+			// Invalidates all fields, should only be used while the owner is not shared.
+			//
+			void reset() { state.store( 0, std::memory_order::relaxed ); }
+		};
+
+		// Out-of-line storage for the unique identifier of symbolic variables, which keeps the large
+		// identifier out of the constant and operation nodes. Shared between copies and owned on write.
+		//
+		struct boxed_identifier
+		{
+			shared_reference<unique_identifier> box = {};
+
+			// Default construction, copy and move.
+			//
+			boxed_identifier() = default;
+			boxed_identifier( boxed_identifier&& ) = default;
+			boxed_identifier( const boxed_identifier& ) = default;
+			boxed_identifier& operator=( boxed_identifier&& ) = default;
+			boxed_identifier& operator=( const boxed_identifier& ) = default;
+
+			// Construct from an identifier, allocates only if it is valid.
+			//
+			explicit boxed_identifier( const unique_identifier& uid ) { if ( uid ) box = uid; }
+
+			// Gets the identifier, null if not boxed.
+			//
+			const unique_identifier& operator*() const
+			{
+				static const unique_identifier null_identifier = {};
+				return box.is_valid() ? *box : null_identifier;
+			}
+			const unique_identifier* operator->() const { return &**this; }
+			operator const unique_identifier&() const { return **this; }
+
+			// Redirect the commonly used helpers to the identifier.
+			//
+			template<typename T> const T& get() const { return box->get<T>(); }
+			template<typename T> T& get() { return box.own()->get<T>(); }
+			hash_t hash() const { return ( **this ).hash(); }
+			const std::string& to_string() const { return ( **this ).to_string(); }
+			explicit operator bool() const { return box.is_valid(); }
+
+			// Comparison operators, boxes sharing the same storage are equal without comparing the values.
+			//
+			bool operator==( const boxed_identifier& o ) const { return box.get() == o.box.get() || **this == *o; }
+			bool operator!=( const boxed_identifier& o ) const { return !operator==( o ); }
+			bool operator<( const boxed_identifier& o ) const { return **this < *o; }
+		};
+	};
+
+	// Enables or disables hash-consing of expression references. When enabled, each reference
+	// constructed from an expression is replaced with the canonical instance held by a global
+	// intern table so that ::is_identical between interned nodes is an integer comparison.
+	//
+	void set_expression_interning( bool enabled );
+	bool is_expression_interning_enabled();
+
+	// Releases the interned expressions that are not referenced outside of the intern table,
+	// returns the number of nodes released.
+	//
+	size_t purge_interned_expressions();
+
+	// Returns the number of nodes in the intern table.
+	//
+	size_t get_interned_expression_count();
+
 	// Expression delegates used to implement copyless write detection 
 	// in case the reference is already owning.
 	//
@@ -98,7 +251,16 @@ namespace vtil::symbolic
 		//
 		template<typename... Tx>
 		expression_reference( Tx&&... args ) 
-			: shared_reference( std::forward<Tx>( args )...) {}
+			: shared_reference( std::forward<Tx>( args )...) 
+		{
+			// If we constructed a new expression and interning is enabled, replace with the canonical instance.
+			//
+			if constexpr ( vtil::impl::should_invoke_constructor<shared_reference<expression>, Tx...>() )
+			{
+				if ( impl::expression_interning.load( std::memory_order::relaxed ) ) [[unlikely]]
+					intern();
+			}
+		}
 
 		using shared_reference::operator bool;
 		using shared_reference::operator*;
@@ -121,6 +283,11 @@ namespace vtil::symbolic
 		[[nodiscard]] expression_reference simplify( bool prettify = false, bool* out = nullptr ) const;
 		[[nodiscard]] expression_reference resize( bitcnt_t new_size, bool signed_cast = false, bool no_explicit = false ) const;
 
+		// Replaces the reference with the canonical instance of the expression from the intern
+		// table, interning the operands first if necessary. Lazy expressions are left as is.
+		//
+		expression_reference& intern();
+
 		// Forward declared redirects for internal use cases.
 		//
 		hash_t hash() const;
@@ -184,19 +351,34 @@ namespace vtil::symbolic
 		using weak_reference =     weak_reference<expression>;
 		using uid_relation_table = std::vector<std::pair<expression::weak_reference, expression::weak_reference>>;
 
-		// If symbolic variable, the unique identifier that it maps to.
+		// Fields are ordered so that the ones consulted while matching (value, operator, flags, hash and 
+		// signature) are packed together at the front of the node, within its first 72 bytes.
 		//
-		unique_identifier uid = {};
 
-		// If operation, identifier of the operator and the sub-expressions for the operands.
+		// If operation, identifier of the operator.
 		//
 		math::operator_id op = math::operator_id::invalid;
-		reference lhs = {};
-		reference rhs = {};
 
-		// An arbitrarily defined complexity value that is used as an inverse reward function in simplification.
+		// Whether expression passed the simplifier already or not, note that this is a hint and there may 
+		// be cases where it already has passed it and this flag was not set. Albeit those cases will most 
+		// likely not cause performance issues due to the caching system.
+		//
+		mutable bool simplify_hint = false;
+
+		// Disables implicit auto-simplification for the expression if is set.
+		//
+		bool is_lazy = false;
+
+		// Fields of the expression that are computed on demand and invalidated by ::update; the hash
+		// used by the simplifier cache, the signature and the complexity, see ::hash, ::signature and 
+		// ::complexity.
+		//
+		mutable impl::lazy_fields lazy_state = {};
+
+		// If operation, the sub-expressions for the operands.
 		//
-		double complexity = 0;
+		reference lhs = {};
+		reference rhs = {};
 
 		// Depth of the current expression.
 		// - If constant or symbolic variable, = 0
@@ -204,23 +386,23 @@ namespace vtil::symbolic
 		//
 		size_t depth = 0;
 
-		// Hash of the expression used by the simplifier cache.
+		// Bounds and stride of the value, complements the known bits of the value and is used to
+		// refine them during the update.
 		//
-		hash_t hash_value = {};
+		math::value_range range = {};
 
-		// Signature of the expression.
+		// X values of the expression, calculated once per update from the operands' x values.
 		//
-		expression_signature signature = {};
+		std::array<uint64_t, VTIL_SYMEX_XVAL_KEYS> xvalue_cache = {};
 
-		// Whether expression passed the simplifier already or not, note that this is a hint and there may 
-		// be cases where it already has passed it and this flag was not set. Albeit those cases will most 
-		// likely not cause performance issues due to the caching system.
+		// If this node is the canonical instance held by the intern table, identifier of the class of 
+		// nodes identical to it, otherwise zero. Not inherited by copies.
 		//
-		mutable bool simplify_hint = false;
+		impl::transient<uint64_t> intern_id = {};
 
-		// Disables implicit auto-simplification for the expression if is set.
+		// If symbolic variable, the unique identifier that it maps to, stored out of line.
 		//
-		bool is_lazy = false;
+		impl::boxed_identifier uid = {};
 
 		// Default constructor and copy/move.
 		//
@@ -237,7 +419,7 @@ namespace vtil::symbolic
 
 		// Constructor for symbolic variables.
 		//
-		expression( const unique_identifier& uid, bitcnt_t bit_count ) : operable(), uid( uid ), simplify_hint( true ) { value = math::bit_vector( bit_count ); update( false ); }
+		expression( const unique_identifier& uid, bitcnt_t bit_count ) : operable(), simplify_hint( true ), uid( uid ) { value = math::bit_vector( bit_count ); update( false ); }
 
 		// Constructor for expressions.
 		//
@@ -277,16 +459,34 @@ namespace vtil::symbolic
 
 		// Helpers to determine the type of the expression.
 		//
-		bool is_variable() const { return uid; }
+		bool is_variable() const { return ( bool ) uid; }
 		bool is_expression() const { return op != math::operator_id::invalid; }
 		bool is_unary() const { return is_expression() && get_op_desc().operand_count == 1; }
 		bool is_binary() const { return is_expression() && get_op_desc().operand_count == 2; }
 		bool is_valid() const { return is_expression() || is_variable() || is_constant(); }
 		explicit operator bool() const { return is_valid(); }
 
-		// Returns the cached hash value to abide the standard vtil::hashable.
+		// Returns the hash value to abide the standard vtil::hashable, the signature and the complexity, 
+		// each computed on first use after the last update.
 		//
-		hash_t hash() const { return hash_value; }
+		hash_t hash() const 
+		{ 
+			if ( !lazy_state.test( impl::lazy_hash ) ) compute_hash(); 
+			return lazy_state.hash_value; 
+		}
+		const expression_signature& signature() const 
+		{ 
+			if ( !lazy_state.test( impl::lazy_signature ) ) compute_signature(); 
+			return lazy_state.signature_value; 
+		}
+		double complexity() const 
+		{ 
+			if ( !lazy_state.test( impl::lazy_complexity ) ) compute_complexity(); 
+			return lazy_state.complexity_value; 
+		}
+		void compute_hash() const;
+		void compute_signature() const;
+		void compute_complexity() const;
 
 		// Returns the number of constants used in the expression.
 		//
@@ -298,12 +498,16 @@ namespace vtil::symbolic
 
 		// Returns the number of unique variables used in the expression.
 		//
-		size_t count_unique_variables( std::set<unique_identifier>* visited = nullptr ) const;
+		size_t count_unique_variables( unique_identifier_set* visited = nullptr ) const;
 
 		// Updates the expression state.
 		//
 		expression& update( bool auto_simplify );
 
+		// Recalculates the x value cache, operands must be up-to-date.
+		//
+		void update_xvalues();
+
 		// Converts to human-readable format.
 		//
 		std::string to_string() const;
@@ -338,11 +542,14 @@ namespace vtil::symbolic
 		//
 		bool contains( const expression& o ) const;
 
-		// Calculates the x values.
+		// Calculates the x values, default key count is served from the cache.
 		//
 		template<size_t N = VTIL_SYMEX_XVAL_KEYS>
 		std::array<uint64_t, N> xvalues() const
 		{
+			if constexpr ( N == VTIL_SYMEX_XVAL_KEYS )
+				return xvalue_cache;
+
 			std::array<uint64_t, N> result;
 		
 			// If binary operation:
@@ -399,9 +606,9 @@ namespace vtil::symbolic
 				for ( auto [out, key, idx] : zip( result, keys, iindices ) )
 				{
 					if ( idx != 0 )
-						out = ( hash_value ^ key ) & value.value_mask();
+						out = ( hash() ^ key ) & value.value_mask();
 					else
-						out = ( hash_value & 64 ) & value.value_mask();
+						out = ( hash() & 64 ) & value.value_mask();
 				}
 			}
 			else
@@ -430,7 +637,7 @@ namespace vtil::symbolic
 			{
 				// If lookup helper passed and succesfully finds the value, use as is.
 				//
-				if ( std::optional<uint64_t> res = lookup( uid ) )
+				if ( std::optional<uint64_t> res = lookup( *uid ) )
 					return { *res, size() };
 			
 				// Otherwise return unknown.
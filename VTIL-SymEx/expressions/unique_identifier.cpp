@@ -26,9 +26,129 @@
 // POSSIBILITY OF SUCH DAMAGE.        
 //
 #include "unique_identifier.hpp"
+#include <shared_mutex>
+#include <mutex>
+#include <unordered_map>
+
+// Number of shards of the identifier interning table, each with its own lock.
+//
+#ifndef VTIL_SYMEX_UID_INTERN_SHARDS
+	#define VTIL_SYMEX_UID_INTERN_SHARDS 16
+#endif
+
+// Number of entries the identifier interning table can hold before it is collected, after which 
+// the identifiers still alive are interned again when their index is next requested.
+//
+#ifndef VTIL_SYMEX_UID_TABLE_LIMIT
+	#define VTIL_SYMEX_UID_TABLE_LIMIT 0x100000
+#endif
 
 namespace vtil::symbolic
 {
+	// Current epoch of the interning table.
+	//
+	std::atomic<uint32_t> impl::identifier_epoch = { 1 };
+
+	// Global table mapping every distinct identifier to a dense index. Entries hold a copy of the
+	// identifier and pin its index until the table is collected, which drops every entry at once 
+	// and starts a new epoch so that the identifiers holding the old indices intern again.
+	//
+	struct identifier_table
+	{
+		struct shard
+		{
+			std::shared_mutex lock;
+			std::unordered_multimap<hash_t, std::pair<unique_identifier, uint32_t>> entries;
+		};
+		shard shards[ VTIL_SYMEX_UID_INTERN_SHARDS ];
+
+		// Index allocator, reset on every collection.
+		//
+		std::atomic<uint32_t> next_id = { 1 };
+
+		// Finds the index of the identifier in the shard, zero if not found.
+		//
+		uint32_t find( shard& sh, const unique_identifier& uid )
+		{
+			auto [it, end] = sh.entries.equal_range( uid.hash_value );
+			for ( ; it != end; ++it )
+				if ( it->second.first.compare_value( it->second.first, uid ) == 0 )
+					return it->second.second;
+			return 0;
+		}
+
+		// Drops every entry and starts a new epoch if the table is over the limit. The entries are 
+		// destroyed after the locks are released as it may take a while.
+		//
+		void collect()
+		{
+			std::vector<decltype( shard::entries )> entries;
+			{
+				std::unique_lock<std::shared_mutex> locks[ VTIL_SYMEX_UID_INTERN_SHARDS ];
+				for ( size_t n = 0; n != VTIL_SYMEX_UID_INTERN_SHARDS; n++ )
+					locks[ n ] = std::unique_lock{ shards[ n ].lock };
+				if ( next_id.load( std::memory_order::relaxed ) <= VTIL_SYMEX_UID_TABLE_LIMIT )
+					return;
+
+				entries.reserve( VTIL_SYMEX_UID_INTERN_SHARDS );
+				for ( auto& sh : shards )
+				{
+					entries.emplace_back( std::move( sh.entries ) );
+					sh.entries.clear();
+				}
+				next_id.store( 1, std::memory_order::relaxed );
+				impl::identifier_epoch.fetch_add( 1, std::memory_order::relaxed );
+			}
+		}
+
+		// Finds or inserts the identifier, returns its index packed with the epoch it belongs to.
+		//
+		uint64_t intern( const unique_identifier& uid )
+		{
+			shard& sh = shards[ uid.hash_value % VTIL_SYMEX_UID_INTERN_SHARDS ];
+			{
+				std::shared_lock _g{ sh.lock };
+				if ( uint32_t id = find( sh, uid ) )
+					return impl::interned_index::pack( id, impl::identifier_epoch.load( std::memory_order::relaxed ) );
+			}
+
+			// Collect the table if it is full before inserting.
+			//
+			if ( next_id.load( std::memory_order::relaxed ) > VTIL_SYMEX_UID_TABLE_LIMIT )
+				collect();
+
+			// Resolve the name before publishing the copy as the string getter mutates it.
+			//
+			unique_identifier copy = uid;
+			copy.interned_id.reset();
+			copy.to_string();
+
+			std::unique_lock _g{ sh.lock };
+			uint32_t id = find( sh, uid );
+			if ( !id )
+			{
+				id = next_id.fetch_add( 1, std::memory_order::relaxed );
+				sh.entries.emplace( uid.hash_value, std::pair{ std::move( copy ), id } );
+			}
+			return impl::interned_index::pack( id, impl::identifier_epoch.load( std::memory_order::relaxed ) );
+		}
+
+		// Intentionally leaked to avoid destruction order issues with identifiers outliving the table.
+		//
+		static identifier_table& get() { static identifier_table* instance = new identifier_table(); return *instance; }
+	};
+
+	// Looks up the identifier in the interning table, inserts it if not found and caches the index.
+	//
+	uint32_t unique_identifier::intern() const
+	{
+		if ( !value )
+			return 0;
+		uint64_t packed = identifier_table::get().intern( *this );
+		interned_id.set( packed );
+		return uint32_t( packed );
+	}
+
 	// Conversion to human-readable format.
 	// - Note: Will cache the return value in string_cast as lambda capture if non-const-qualified.
 	//
@@ -55,6 +175,12 @@ namespace vtil::symbolic
 		if ( !value ) return !o.value;
 		if ( !o.value ) return false;
 
+		// If both are interned in the same epoch, compare the indices.
+		//
+		uint64_t a = interned_id.get();
+		uint64_t b = o.interned_id.get();
+		if ( a && b && ( a >> 32 ) == ( b >> 32 ) ) return a == b;
+
 		// Assert internal equivalance.
 		//
 		return compare_value( *this, o ) == 0;
@@ -71,6 +197,12 @@ namespace vtil::symbolic
 		if ( hash_value != o.hash_value )
 			return hash_value < o.hash_value;
 
+		// If both are interned and equal, skip comparing the internals.
+		//
+		uint64_t a = interned_id.get();
+		if ( a && a == o.interned_id.get() )
+			return false;
+
 		// Compare internals if equivalent hash.
 		//
 		return compare_value( *this, o ) < 0;
@@ -29,11 +29,58 @@
 #include <vtil/math>
 #include <vtil/utility>
 #include <functional>
+#include <vector>
+#include <atomic>
 #include <stdlib.h>
 #include <vtil/io>
 
 namespace vtil::symbolic
 {
+	namespace impl
+	{
+		// Current epoch of the interning table, incremented every time the table is collected
+		// which invalidates all indices assigned before.
+		//
+		extern std::atomic<uint32_t> identifier_epoch;
+
+		// Dense index assigned by the interning table along with the epoch it was assigned in, 
+		// the index is pinned by the table entry until the table is collected so copies are plain.
+		//
+		struct interned_index
+		{
+			std::atomic<uint64_t> value = { 0 };
+
+			// Default constructor/copy, moves copy the index as well.
+			//
+			interned_index() = default;
+			interned_index( const interned_index& o ) : value( o.get() ) {}
+			interned_index& operator=( const interned_index& o ) { set( o.get() ); return *this; }
+
+			// Packs the index and the epoch.
+			//
+			static constexpr uint64_t pack( uint32_t id, uint32_t epoch ) { return id | ( uint64_t( epoch ) << 32 ); }
+
+			// Gets the packed index, zero if none, only comparable to indices of the same epoch.
+			//
+			uint64_t get() const { return value.load( std::memory_order::relaxed ); }
+
+			// Gets the index if it is of the current epoch, zero otherwise.
+			//
+			uint32_t current() const
+			{
+				uint64_t packed = get();
+				if ( uint32_t( packed >> 32 ) != identifier_epoch.load( std::memory_order::relaxed ) )
+					return 0;
+				return uint32_t( packed );
+			}
+
+			// Replaces the packed index.
+			//
+			void set( uint64_t packed = 0 ) { value.store( packed, std::memory_order::relaxed ); }
+			void reset() { set(); }
+		};
+	};
+
 	// Unique identifier type to be used within symbolic expression context.
 	//
 	struct unique_identifier
@@ -54,6 +101,11 @@ namespace vtil::symbolic
 		//
 		variant value;
 
+		// Dense index assigned by the interning table, equal for all identifiers that compare equal
+		// within the same epoch and zero if not yet interned or invalidated by mutable access to the value.
+		//
+		mutable impl::interned_index interned_id = {};
+
 		// Default constructor/copy/move.
 		//
 		unique_identifier() : value( std::nullopt ) {};
@@ -140,10 +192,26 @@ namespace vtil::symbolic
 			value = v;
 		}
 
-		// Gets the value stored by this structure.
+		// Gets the value stored by this structure, mutable access invalidates the interned index.
 		//
 		template<typename T> const T& get() const { return value.get<T>(); }
-		template<typename T> T& get() { return value.get<T>(); }
+		template<typename T> T& get() { interned_id.reset(); return value.get<T>(); }
+
+		// Gets the dense index of the identifier, interning it if not done already. Indices start
+		// from one and are shared by all identifiers that compare equal, zero is reserved for null.
+		// - Indices are reused once the interning table is collected, after which the identifier 
+		//   is interned again.
+		//
+		uint32_t id() const
+		{
+			if ( uint32_t i = interned_id.current() )
+				return i;
+			return intern();
+		}
+
+		// Looks up the identifier in the interning table, inserts it if not found and caches the index.
+		//
+		uint32_t intern() const;
 
 		// Returns the cached hash value to abide the standard vtil::hashable.
 		//
@@ -164,4 +232,38 @@ namespace vtil::symbolic
 		bool operator<( const unique_identifier& o ) const;
 		bool operator!=( const unique_identifier& o ) const { return !operator==( o ); }
 	};
+
+	// Small set of identifiers referenced in place, only valid while the identifiers inserted are alive.
+	// The few identifiers an expression uses are kept on the stack and compared by hash first.
+	//
+	struct unique_identifier_set
+	{
+		stack_vector<const unique_identifier*, 8> entries;
+
+		// Inserts the identifier, returns false if it was already in the set.
+		//
+		bool insert( const unique_identifier& uid )
+		{
+			if ( contains( uid ) )
+				return false;
+			entries.emplace_back( &uid );
+			return true;
+		}
+
+		// Checks if the identifier is in the set.
+		//
+		bool contains( const unique_identifier& uid ) const
+		{
+			for ( const unique_identifier* entry : entries )
+				if ( entry == &uid || ( entry->hash_value == uid.hash_value && *entry == uid ) )
+					return true;
+			return false;
+		}
+
+		// Returns the number of identifiers in the set.
+		//
+		size_t size() const { return entries.size(); }
+		bool empty() const { return entries.empty(); }
+		void clear() { entries.clear(); }
+	};
 };
\ No newline at end of file
@@ -0,0 +1,464 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of VTIL Project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software 
+//    without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "saturation.hpp"
+#include "simplifier.hpp"
+#include "../directives/transformer.hpp"
+#include <vtil/io>
+#include <vtil/utility>
+#include <mutex>
+#include <limits>
+#include <unordered_map>
+
+namespace vtil::symbolic
+{
+	// Global configuration.
+	//
+	static std::mutex saturation_config_lock;
+	static saturation_config global_saturation_config = {};
+
+	void set_simplifier_engine( simplifier_engine engine ) { impl::saturation_selected = engine == simplifier_engine::saturation; }
+	simplifier_engine get_simplifier_engine() { return impl::saturation_selected ? simplifier_engine::saturation : simplifier_engine::greedy; }
+	void set_saturation_config( const saturation_config& config ) { std::lock_guard _g{ saturation_config_lock }; global_saturation_config = config; }
+	saturation_config get_saturation_config() { std::lock_guard _g{ saturation_config_lock }; return global_saturation_config; }
+
+	// Conversion to human-readable format.
+	//
+	std::string saturation_stats::to_string() const
+	{
+		return format::str(
+			"iterations=%llu nodes=%llu classes=%llu rewrites=%llu unions=%llu saturated=%d complexity=%.2lf=>%.2lf",
+			iterations, nodes, classes, rewrites, unions, saturated, input_complexity, output_complexity
+		);
+	}
+
+	// E-graph over expressions, each e-class holds a set of e-nodes that are known to be equivalent
+	// where the operands of an e-node are e-classes rather than expressions.
+	//
+	struct egraph
+	{
+		static constexpr uint32_t no_class = ~0u;
+
+		struct enode
+		{
+			// Operator and the operand classes if operation, the expression itself otherwise.
+			//
+			math::operator_id op = math::operator_id::invalid;
+			uint32_t lhs = no_class;
+			uint32_t rhs = no_class;
+			expression::reference leaf = {};
+
+			// Owning class and whether or not it is the canonical copy.
+			//
+			uint32_t owner = no_class;
+			bool live = true;
+
+			// Constructs a leaf or an operation.
+			//
+			static enode make_leaf( expression::reference exp ) { enode n; n.leaf = std::move( exp ); return n; }
+			static enode make_operation( math::operator_id op, uint32_t lhs, uint32_t rhs ) { enode n; n.op = op; n.lhs = lhs; n.rhs = rhs; return n; }
+		};
+
+		struct eclass
+		{
+			bitcnt_t size = 0;
+			std::vector<uint32_t> nodes;
+
+			// Cheapest term and its complexity as of the last extraction.
+			//
+			expression::reference best = {};
+			double cost = std::numeric_limits<double>::infinity();
+		};
+
+		std::vector<enode> nodes;
+		std::vector<eclass> classes;
+		std::vector<uint32_t> parents;
+		std::unordered_multimap<uint64_t, uint32_t> hashcons;
+		std::unordered_map<const expression*, std::pair<expression::reference, uint32_t>> term_cache;
+
+		// Union-find over the classes.
+		//
+		uint32_t find( uint32_t id ) const
+		{
+			while ( parents[ id ] != id )
+				id = parents[ id ];
+			return id;
+		}
+		bool merge( uint32_t a, uint32_t b )
+		{
+			a = find( a );
+			b = find( b );
+			if ( a == b )
+				return false;
+			if ( classes[ a ].nodes.size() < classes[ b ].nodes.size() )
+				std::swap( a, b );
+
+			parents[ b ] = a;
+			auto& ca = classes[ a ];
+			auto& cb = classes[ b ];
+			ca.nodes.insert( ca.nodes.end(), cb.nodes.begin(), cb.nodes.end() );
+			cb.nodes.clear();
+			if ( cb.cost < ca.cost )
+			{
+				ca.cost = cb.cost;
+				ca.best = std::move( cb.best );
+			}
+			return true;
+		}
+
+		// Canonicalizes the operands of the e-node and returns its key in the hash-cons table.
+		//
+		uint64_t canonicalize( enode& n ) const
+		{
+			if ( n.op == math::operator_id::invalid )
+				return n.leaf->hash().as64();
+
+			if ( n.lhs != no_class ) n.lhs = find( n.lhs );
+			n.rhs = find( n.rhs );
+			if ( n.lhs != no_class && n.lhs > n.rhs && math::descriptor_of( n.op ).is_commutative )
+				std::swap( n.lhs, n.rhs );
+			return ( uint64_t( n.op ) << 56 ) ^ ( uint64_t( n.lhs ) * 0x9E3779B97F4A7C15 ) ^ ( uint64_t( n.rhs ) * 0xC2B2AE3D27D4EB4F );
+		}
+		static bool is_same( const enode& a, const enode& b )
+		{
+			if ( a.op != b.op )
+				return false;
+			if ( a.op == math::operator_id::invalid )
+				return a.leaf->is_identical( *b.leaf );
+			return a.lhs == b.lhs && a.rhs == b.rhs;
+		}
+		uint32_t lookup( uint64_t key, const enode& n ) const
+		{
+			auto [it, end] = hashcons.equal_range( key );
+			for ( ; it != end; ++it )
+				if ( is_same( nodes[ it->second ], n ) )
+					return it->second;
+			return no_class;
+		}
+
+		// Adds the e-node into the graph unless an identical one exists, returns its class.
+		//
+		uint32_t add( enode&& n, bitcnt_t size )
+		{
+			uint64_t key = canonicalize( n );
+			if ( uint32_t existing = lookup( key, n ); existing != no_class )
+				return find( nodes[ existing ].owner );
+
+			uint32_t node_id = ( uint32_t ) nodes.size();
+			uint32_t class_id = ( uint32_t ) classes.size();
+			n.owner = class_id;
+			nodes.emplace_back( std::move( n ) );
+			parents.emplace_back( class_id );
+			classes.emplace_back().size = size;
+			classes.back().nodes.emplace_back( node_id );
+			hashcons.emplace( key, node_id );
+			return class_id;
+		}
+
+		// Adds every subterm of the expression into the graph, returns the class of the root.
+		//
+		uint32_t add_term( const expression::reference& exp )
+		{
+			if ( auto it = term_cache.find( exp.get() ); it != term_cache.end() )
+				return find( it->second.second );
+
+			uint32_t id;
+			if ( !exp->is_expression() )
+			{
+				id = add( enode::make_leaf( exp ), exp->size() );
+			}
+			else
+			{
+				uint32_t lhs = exp->lhs ? add_term( exp->lhs ) : no_class;
+				uint32_t rhs = add_term( exp->rhs );
+				id = add( enode::make_operation( exp->op, lhs, rhs ), exp->size() );
+
+				// If the value is known, merge with the constant.
+				//
+				if ( exp->value.is_known() )
+				{
+					expression::reference cst = expression{ exp->value.known_one(), exp->size() };
+					id = ( merge( id, add( enode::make_leaf( std::move( cst ) ), exp->size() ) ), find( id ) );
+				}
+			}
+			term_cache.emplace( exp.get(), std::pair{ exp, id } );
+			return id;
+		}
+
+		// Restores the congruence invariant after merges, e-nodes that became identical are merged
+		// along with their classes until no more merges happen. Returns the number of merges.
+		//
+		size_t rebuild()
+		{
+			size_t count = 0, n;
+			do
+			{
+				n = 0;
+				hashcons.clear();
+				for ( auto [node, id] : zip( nodes, iindices ) )
+				{
+					if ( !node.live )
+						continue;
+					uint64_t key = canonicalize( node );
+					if ( uint32_t existing = lookup( key, node ); existing != no_class )
+					{
+						n += merge( nodes[ existing ].owner, node.owner );
+						node.live = false;
+					}
+					else
+					{
+						hashcons.emplace( key, ( uint32_t ) id );
+					}
+				}
+				count += n;
+			}
+			while ( n );
+
+			// Drop the duplicate e-nodes from the classes.
+			//
+			for ( auto [cls, id] : zip( classes, iindices ) )
+			{
+				if ( parents[ id ] == id )
+					std::erase_if( cls.nodes, [ & ] ( uint32_t i ) { return !nodes[ i ].live; } );
+			}
+			return count;
+		}
+
+		// Instantiates the e-node with the cheapest operand terms or the ones given, null if an
+		// operand has no term yet.
+		//
+		expression::reference instantiate( const enode& n, const expression::reference* lhs = nullptr, const expression::reference* rhs = nullptr ) const
+		{
+			if ( n.op == math::operator_id::invalid )
+				return n.leaf;
+
+			if ( !rhs ) rhs = &classes[ find( n.rhs ) ].best;
+			if ( !*rhs ) return {};
+			if ( n.lhs == no_class )
+				return expression::make( n.op, *rhs );
+
+			if ( !lhs ) lhs = &classes[ find( n.lhs ) ].best;
+			if ( !*lhs ) return {};
+			return expression::make( *lhs, n.op, *rhs );
+		}
+
+		// Determines the cheapest term of each class, costs only ever decrease so iterating
+		// until no class improves converges even if the graph is cyclic.
+		//
+		void extract()
+		{
+			for ( size_t pass = 0; pass <= classes.size(); pass++ )
+			{
+				bool changed = false;
+				for ( auto& node : nodes )
+				{
+					if ( !node.live )
+						continue;
+					auto& cls = classes[ find( node.owner ) ];
+					if ( auto term = instantiate( node ) )
+					{
+						double cost = term->complexity();
+						if ( cost < cls.cost )
+						{
+							cls.cost = cost;
+							cls.best = std::move( term );
+							changed = true;
+						}
+					}
+				}
+				if ( !changed )
+					break;
+			}
+		}
+
+		// Returns the terms of the class the directives are matched against.
+		//
+		std::vector<expression::reference> sample( uint32_t id, size_t max_samples ) const
+		{
+			auto& cls = classes[ find( id ) ];
+			std::vector<expression::reference> result;
+			if ( !cls.best )
+				return result;
+			result.emplace_back( cls.best );
+			for ( uint32_t node : cls.nodes )
+			{
+				if ( result.size() >= max_samples )
+					break;
+				if ( auto term = instantiate( nodes[ node ] ); term && !term->is_identical( *cls.best ) )
+					result.emplace_back( std::move( term ) );
+			}
+			return result;
+		}
+	};
+
+	// Simplifies the expression by equality saturation, returns whether the expression was changed.
+	//
+	bool simplify_expression_saturated( expression::reference& exp, bool pretty, const saturation_config& config, saturation_stats* stats )
+	{
+		saturation_stats local_stats;
+		if ( !stats ) stats = &local_stats;
+		*stats = {};
+		stats->input_complexity = exp->complexity();
+
+		// If not an expression, there is nothing to rewrite.
+		//
+		if ( !exp->is_expression() )
+		{
+			stats->output_complexity = stats->input_complexity;
+			stats->saturated = true;
+			return false;
+		}
+
+		// Nested simplifier invocations should use the greedy engine.
+		//
+		impl::saturation_depth++;
+		finally _g( [ ] () { impl::saturation_depth--; } );
+		auto time_limit = std::chrono::steady_clock::now() + config.time_budget;
+
+		// Load the expression and the greedy result if requested.
+		//
+		egraph graph;
+		uint32_t root = graph.add_term( exp );
+		if ( config.seed_with_greedy )
+		{
+			expression::reference seed = exp;
+			simplify_expression( seed, false );
+			graph.merge( root, graph.add_term( seed ) );
+			graph.rebuild();
+		}
+
+		// Rewrite until saturation or until the budget is exhausted.
+		//
+		for ( ; stats->iterations != config.max_iterations; stats->iterations++ )
+		{
+			graph.extract();
+
+			// Match the directives against the sampled terms of each operation and collect the results,
+			// new classes are not visited until the next iteration.
+			//
+			std::vector<std::pair<uint32_t, expression::reference>> pending;
+			std::vector<std::vector<expression::reference>> samples( graph.classes.size() );
+			auto get_samples = [ & ] ( uint32_t id ) -> const std::vector<expression::reference>&
+			{
+				id = graph.find( id );
+				if ( samples[ id ].empty() )
+					samples[ id ] = graph.sample( id, std::max<size_t>( config.max_samples, 1 ) );
+				return samples[ id ];
+			};
+
+			bool out_of_budget = false;
+			for ( size_t id = 0; id != graph.classes.size() && !out_of_budget; id++ )
+			{
+				if ( graph.parents[ id ] != id )
+					continue;
+				for ( uint32_t node_id : graph.classes[ id ].nodes )
+				{
+					if ( std::chrono::steady_clock::now() >= time_limit )
+					{
+						out_of_budget = true;
+						break;
+					}
+
+					const egraph::enode& node = graph.nodes[ node_id ];
+					if ( node.op == math::operator_id::invalid )
+						continue;
+
+					static const std::vector<expression::reference> no_operand = { expression::reference{} };
+					auto& lhs_samples = node.lhs != egraph::no_class ? get_samples( node.lhs ) : no_operand;
+					auto& rhs_samples = get_samples( node.rhs );
+					for ( auto& lhs : lhs_samples )
+					{
+						for ( auto& rhs : rhs_samples )
+						{
+							expression::reference term = lhs ? graph.instantiate( node, &lhs, &rhs ) : graph.instantiate( node, nullptr, &rhs );
+							if ( !term || term->value.is_known() )
+								continue;
+
+							impl::enumerate_simplifier_directives( *term, [ & ] ( const directive::instance* from, const directive::instance* to )
+							{
+								if ( auto result = transform( term, from, to ) )
+								{
+									pending.emplace_back( ( uint32_t ) id, std::move( result ) );
+									stats->rewrites++;
+								}
+							} );
+						}
+					}
+				}
+			}
+
+			// Add the results to the graph and restore the invariants.
+			//
+			size_t prev_node_count = graph.nodes.size();
+			size_t unions = 0;
+			for ( auto& [id, result] : pending )
+			{
+				if ( graph.nodes.size() >= config.max_nodes )
+				{
+					out_of_budget = true;
+					break;
+				}
+				unions += graph.merge( id, graph.add_term( result ) );
+			}
+			unions += graph.rebuild();
+			stats->unions += unions;
+
+			// Stop if saturated or if the budget is exhausted.
+			//
+			if ( !unions && graph.nodes.size() == prev_node_count && !out_of_budget )
+			{
+				stats->saturated = true;
+				stats->iterations++;
+				break;
+			}
+			if ( out_of_budget )
+			{
+				stats->iterations++;
+				break;
+			}
+		}
+
+		// Extract the cheapest term.
+		//
+		graph.extract();
+		stats->nodes = graph.nodes.size();
+		stats->classes = std::count_if( graph.parents.begin(), graph.parents.end(), [ &, i = 0u ] ( uint32_t p ) mutable { return p == i++; } );
+
+		expression::reference result = graph.classes[ graph.find( root ) ].best;
+		if ( pretty )
+			simplify_expression( result, true );
+		stats->output_complexity = result->complexity();
+
+		// Replace the expression if it was changed.
+		//
+		if ( exp->is_identical( *result ) )
+			return false;
+		exp = std::move( result );
+		exp->simplify_hint = true;
+		return true;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,142 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of VTIL Project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software 
+//    without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include "../expressions/expression.hpp"
+#include "../directives/directive.hpp"
+
+// [Configuration]
+// Determine the default budget of the equality saturation engine, can be changed at runtime
+// with ::set_saturation_config or passed per call.
+//
+#ifndef VTIL_SYMEX_SATURATION_MAX_NODES
+	#define VTIL_SYMEX_SATURATION_MAX_NODES         0x1000
+#endif
+#ifndef VTIL_SYMEX_SATURATION_MAX_ITERATIONS
+	#define VTIL_SYMEX_SATURATION_MAX_ITERATIONS    8
+#endif
+#ifndef VTIL_SYMEX_SATURATION_TIME_BUDGET_MS
+	#define VTIL_SYMEX_SATURATION_TIME_BUDGET_MS    50
+#endif
+#ifndef VTIL_SYMEX_SATURATION_SAMPLES
+	#define VTIL_SYMEX_SATURATION_SAMPLES           3
+#endif
+
+namespace vtil::symbolic
+{
+	// Engine used by ::simplify_expression.
+	//
+	// - greedy:     Rewrites the expression bottom-up, taking the first directive that applies.
+	// - saturation: Loads the expression into an e-graph, applies every directive that applies
+	//               until saturation or until the budget is exhausted and extracts the term with
+	//               the lowest complexity, see ::simplify_expression_saturated.
+	//
+	enum class simplifier_engine : uint8_t
+	{
+		greedy,
+		saturation,
+	};
+
+	// Budget of the equality saturation engine.
+	//
+	struct saturation_config
+	{
+		// Maximum number of e-nodes and rewrite iterations.
+		//
+		size_t max_nodes = VTIL_SYMEX_SATURATION_MAX_NODES;
+		size_t max_iterations = VTIL_SYMEX_SATURATION_MAX_ITERATIONS;
+
+		// Wall time after which no more rewrites are started.
+		//
+		std::chrono::milliseconds time_budget = std::chrono::milliseconds{ VTIL_SYMEX_SATURATION_TIME_BUDGET_MS };
+
+		// Number of terms of each e-class the directives are matched against, the cheapest one
+		// first and then the other e-nodes of the class instantiated with the cheapest operands.
+		//
+		size_t max_samples = VTIL_SYMEX_SATURATION_SAMPLES;
+
+		// Whether or not the result of the greedy simplifier is added to the e-graph as a seed,
+		// which guarantees the result is never more complex than the greedy one.
+		//
+		bool seed_with_greedy = true;
+	};
+
+	// Statistics of a single saturation run.
+	//
+	struct saturation_stats
+	{
+		size_t iterations = 0;
+		size_t nodes = 0;
+		size_t classes = 0;
+		size_t rewrites = 0;
+		size_t unions = 0;
+		bool saturated = false;
+		double input_complexity = 0;
+		double output_complexity = 0;
+
+		// Conversion to human-readable format.
+		//
+		std::string to_string() const;
+	};
+
+	// Gets or sets the engine used by ::simplify_expression globally, and the default budget of
+	// the equality saturation engine.
+	//
+	void set_simplifier_engine( simplifier_engine engine );
+	simplifier_engine get_simplifier_engine();
+	void set_saturation_config( const saturation_config& config );
+	saturation_config get_saturation_config();
+
+	// Simplifies the expression by equality saturation, returns whether the expression was changed.
+	// Simplifier invocations made by the directives themselves use the greedy engine.
+	//
+	bool simplify_expression_saturated( expression::reference& exp, bool pretty = false,
+										const saturation_config& config = get_saturation_config(),
+										saturation_stats* stats = nullptr );
+
+	// Internal interface between the simplifier and the saturation engine.
+	//
+	namespace impl
+	{
+		// Set if ::simplify_expression should redirect to the saturation engine.
+		//
+		inline std::atomic<bool> saturation_selected = false;
+
+		// Depth of the saturation engine on the current thread, nested simplifier invocations
+		// are never redirected.
+		//
+		inline thread_local size_t saturation_depth = 0;
+
+		// Enumerates the simplifier directives that can structurally match the expression in the
+		// order the greedy simplifier tries them.
+		//
+		void enumerate_simplifier_directives( const expression& exp, const std::function<void( const directive::instance*, const directive::instance* )>& fn );
+	};
+};
\ No newline at end of file
@@ -26,25 +26,39 @@
 // POSSIBILITY OF SUCH DAMAGE.        
 //
 #include "simplifier.hpp"
+#include "simplifier_memo.hpp"
+#include "saturation.hpp"
 #include "directives.hpp"
 #include "boolean_directives.hpp"
 #include "../expressions/expression.hpp"
 #include "../directives/transformer.hpp"
+#include "../directives/discrimination_index.hpp"
 #include <vtil/io>
 #include <vtil/utility>
+#include <atomic>
+#include <memory>
+#include <exception>
 
 // [Configuration]
-// Determine the depth limit after which we start self generated signature matching and
-// the properties of the LRU cache.
+// Determine the depth limit after which we start self generated signature matching.
 //
 #ifndef VTIL_SYMEX_SELFGEN_SIGMATCH_DEPTH_LIM
 	#define	VTIL_SYMEX_SELFGEN_SIGMATCH_DEPTH_LIM   3
 #endif
-#ifndef VTIL_SYMEX_LRU_CACHE_SIZE
-	#define VTIL_SYMEX_LRU_CACHE_SIZE               0x10000
+
+// [Configuration]
+// Determine the properties of the cache shared across threads that is consulted 
+// when the thread-local cache misses, size of zero removes it. It is disabled unless
+// enabled here or at runtime with ::set_shared_simplifier_cache.
+//
+#ifndef VTIL_SYMEX_SHARED_CACHE_SIZE
+	#define VTIL_SYMEX_SHARED_CACHE_SIZE            0x40000
 #endif
-#ifndef VTIL_SYMEX_LRU_PRUNE_COEFF
-	#define VTIL_SYMEX_LRU_PRUNE_COEFF              0.35
+#ifndef VTIL_SYMEX_SHARED_CACHE_ENABLED
+	#define VTIL_SYMEX_SHARED_CACHE_ENABLED         false
+#endif
+#ifndef VTIL_SYMEX_SHARED_CACHE_SHARDS
+	#define VTIL_SYMEX_SHARED_CACHE_SHARDS          64
 #endif
 namespace vtil::symbolic
 {
@@ -56,12 +70,13 @@ namespace vtil::symbolic
 		}
 	};
 
-	// Implement lookup-table based dynamic tables.
+	// Implement lookup-table based dynamic tables, each list is compiled into a discrimination
+	// index so that only the directives that can structurally match are tried.
 	//
 	using static_directive_table_entry =  std::pair<directive::instance,        directive::instance>;
 	using dynamic_directive_table_entry = std::pair<const directive::instance*, const directive::instance*>;
 
-	using dynamic_directive_table =       std::vector<dynamic_directive_table_entry>;
+	using dynamic_directive_table =       directive::discrimination_index;
 	using organized_directive_table =     std::array<dynamic_directive_table, ( size_t ) math::operator_id::max>;
 
 	template<typename T>
@@ -69,9 +84,13 @@ namespace vtil::symbolic
 	{
 		organized_directive_table table;
 		for ( auto [table, op] : zip( table, iindices ) )
+		{
+			std::vector<dynamic_directive_table_entry> list;
 			for( auto& directive : container )
 				if ( directive.first.op == ( math::operator_id ) op )
-					table.emplace_back( &directive.first, &directive.second );
+					list.emplace_back( &directive.first, &directive.second );
+			table = dynamic_directive_table{ std::move( list ) };
+		}
 		return table;
 	};
 
@@ -82,12 +101,23 @@ namespace vtil::symbolic
 	static auto& get_boolean_simplifiers( math::operator_id op )   { static const auto tbl = build_dynamic_table( directive::build_boolean_simplifiers() ); return tbl[ ( size_t ) op ]; }
 	static auto& get_universal_simplifiers( math::operator_id op ) { static const auto tbl = build_dynamic_table( directive::universal_simplifiers );       return tbl[ ( size_t ) op ]; }
 
+	// Cache properties set for the current thread, inherited by every state created on it.
+	//
+	static thread_local simplifier_cache_config thread_cache_config = {};
+
 	// Thread local simplifier state.
 	//
 	struct simplifier_state
 	{
-		static constexpr size_t max_cache_entries = VTIL_SYMEX_LRU_CACHE_SIZE;
-		static constexpr size_t cache_prune_count = ( size_t ) ( max_cache_entries * VTIL_SYMEX_LRU_PRUNE_COEFF );
+		// Properties of the cache, see ::simplifier_cache_config.
+		//
+		simplifier_cache_config config = thread_cache_config;
+		size_t max_cache_entries = config.max_entries;
+		size_t cache_prune_count = std::max<size_t>( ( size_t ) ( max_cache_entries * config.prune_coefficient ), 1 );
+
+		// Statistics of the cache.
+		//
+		simplifier_cache_stats stats = {};
 
 		// Declare custom hash / equivalence checks hijacking the hash map iteration.
 		//
@@ -128,7 +158,7 @@ namespace vtil::symbolic
 
 		struct signature_hasher
 		{
-			size_t operator()( const expression::reference& ref ) const noexcept { return ref->signature.hash(); }
+			size_t operator()( const expression::reference& ref ) const noexcept { return ref->signature().hash(); }
 		};
 
 		struct cache_scanner
@@ -230,6 +260,31 @@ namespace vtil::symbolic
 			map.reserve( max_cache_entries );
 		}
 
+		// Changes the properties of the cache, evicting entries if it no longer fits.
+		//
+		void configure( const simplifier_cache_config& new_config )
+		{
+			fassert( new_config.max_entries > 1 && 0 < new_config.prune_coefficient && new_config.prune_coefficient <= 1 );
+			fassert( !scope.head );
+
+			config = new_config;
+			max_cache_entries = config.max_entries;
+			cache_prune_count = std::max<size_t>( ( size_t ) ( max_cache_entries * config.prune_coefficient ), 1 );
+			if ( lru_queue.size() >= ( max_cache_entries - 1 ) )
+				prune();
+			map.reserve( max_cache_entries );
+		}
+
+		// Returns a snapshot of the statistics.
+		//
+		simplifier_cache_stats snapshot() const
+		{
+			simplifier_cache_stats result = stats;
+			result.entries = map.size();
+			result.config = config;
+			return result;
+		}
+
 		// Begins speculative execution.
 		//
 		void begin_speculative()
@@ -297,19 +352,27 @@ namespace vtil::symbolic
 
 			// If we reached max entries, prune:
 			//
-			if ( lru_queue.size() == ( max_cache_entries - 1 ) )
+			if ( lru_queue.size() >= ( max_cache_entries - 1 ) )
+				prune();
+		}
+
+		// Evicts the least recently used entries until the cache is [cache_prune_count] entries below the limit.
+		//
+		void prune()
+		{
+			size_t count = 0;
+			for ( auto it = lru_queue.head; it && ( lru_queue.size() + cache_prune_count ) > max_cache_entries; )
 			{
-				for ( auto it = lru_queue.head; it && ( lru_queue.size() + cache_prune_count ) > max_cache_entries; )
-				{
-					auto next = it->next;
-					// Erase if not locked:
-					//
-					cache_value* value = it->get( &cache_value::lru_key );
-					if ( value->lock_count <= 0 )
-						erase( value );
-					it = next;
-				}
+				auto next = it->next;
+				// Erase if not locked:
+				//
+				cache_value* value = it->get( &cache_value::lru_key );
+				if ( value->lock_count <= 0 )
+					erase( value ), count++;
+				it = next;
 			}
+			stats.prunes++;
+			stats.pruned_entries += count;
 		}
 
 		// References to cache from the active scope.
@@ -355,6 +418,7 @@ namespace vtil::symbolic
 			// Speculatively lock the entry.
 			//
 			it->second.lock_count++;
+			stats.lookups++;
 
 			// If we inserted a new entry:
 			//
@@ -362,11 +426,12 @@ namespace vtil::symbolic
 			{
 				// If there is a partial match:
 				//
-				if ( auto base = sig_search.match )
+				if ( auto base = sig_search.match; base && base != &it->second )
 				{
 					// Reset inserted flag.
 					//
 					inserted = false;
+					stats.signature_matches++;
 
 					// If simplified, transform according to the UID table.
 					//
@@ -414,6 +479,7 @@ namespace vtil::symbolic
 			}
 			else
 			{
+				stats.hits++;
 				lru_queue.erase( &it->second.lru_key );
 			}
 
@@ -428,9 +494,162 @@ namespace vtil::symbolic
 		}
 	};
 
+	// The state belongs to the thread rather than the task so that items executed while waiting
+	// share the warm cache, the simplifier never waits for tasks so it cannot be re-entered.
+	//
 	static task_local( simplifier_state ) local_state;
+
+	// Second-level simplifier cache shared across threads, split into shards of set-associative
+	// tables holding atomic pointers to immutable entries so that lookups never take a lock.
+	//
+	struct shared_simplifier_cache
+	{
+		static constexpr size_t shard_count = VTIL_SYMEX_SHARED_CACHE_SHARDS;
+		static constexpr size_t way_count = 4;
+		static constexpr size_t set_count = std::max<size_t>( VTIL_SYMEX_SHARED_CACHE_SIZE / ( shard_count * way_count ), 1 );
+
+		struct entry
+		{
+			expression::reference key;
+			expression::reference result;
+			bool is_simplified;
+		};
+		using slot = std::atomic<std::shared_ptr<const entry>>;
+		using set = std::array<slot, way_count>;
+
+		struct shard
+		{
+			std::array<set, set_count> sets;
+			std::atomic<uint32_t> victim = { 0 };
+		};
+		std::unique_ptr<shard[]> shards{ new shard[ shard_count ] };
+
+		// Whether the cache is enabled and whether anything was inserted since the last purge.
+		//
+		inline static std::atomic<bool> enabled = VTIL_SYMEX_SHARED_CACHE_ENABLED;
+		std::atomic<bool> populated = false;
+
+		// Returns the shard and the set the expression belongs to.
+		//
+		std::pair<shard&, set&> locate( const expression::reference& exp ) const
+		{
+			uint64_t hash = exp->hash().as64();
+			shard& sh = shards[ hash % shard_count ];
+			return { sh, sh.sets[ ( hash / shard_count ) % set_count ] };
+		}
+
+		// Looks up the expression in the cache, returns null if not found.
+		//
+		std::shared_ptr<const entry> find( const expression::reference& exp ) const
+		{
+			auto [sh, set] = locate( exp );
+			for ( auto& slot : set )
+			{
+				auto entry = slot.load( std::memory_order_acquire );
+				if ( entry && entry->key->hash() == exp->hash() && entry->key->is_identical( *exp ) )
+					return entry;
+			}
+			return nullptr;
+		}
+
+		// Inserts the result of the simplification into the cache, takes the place of an 
+		// empty way if any or evicts one in a round-robin fashion.
+		//
+		void insert( const expression::reference& exp, const expression::reference& result, bool is_simplified )
+		{
+			auto [sh, set] = locate( exp );
+			auto value = std::make_shared<const entry>( entry{ exp, result, is_simplified } );
+			populated.store( true, std::memory_order_relaxed );
+			for ( auto& slot : set )
+			{
+				std::shared_ptr<const entry> expected = nullptr;
+				if ( !slot.load( std::memory_order_relaxed ) && slot.compare_exchange_strong( expected, value ) )
+					return;
+			}
+			set[ sh.victim++ % way_count ].store( std::move( value ), std::memory_order_release );
+		}
+
+		// Releases every entry in the cache.
+		//
+		void purge()
+		{
+			if ( !populated.exchange( false ) )
+				return;
+			for ( size_t n = 0; n != shard_count; n++ )
+				for ( auto& set : shards[ n ].sets )
+					for ( auto& slot : set )
+						slot.store( nullptr, std::memory_order_release );
+		}
+
+		// Returns the global instance, intentionally leaked to avoid destroying the
+		// expressions after the allocators are gone.
+		//
+		static shared_simplifier_cache* instance()
+		{
+			static shared_simplifier_cache* instance = new shared_simplifier_cache();
+			return instance;
+		}
+
+		// Returns the global instance if the cache is enabled, null otherwise.
+		//
+		static shared_simplifier_cache* get()
+		{
+			if constexpr ( VTIL_SYMEX_SHARED_CACHE_SIZE == 0 )
+				return nullptr;
+			if ( !enabled.load( std::memory_order_relaxed ) )
+				return nullptr;
+			return instance();
+		}
+	};
+
+	// Publishes the result of the simplification into the shared cache and the memo at the end of
+	// the scope, unless it is speculative, failed due to the depth limit, or if an exception was thrown.
+	//
+	struct scope_shared_cache_publish
+	{
+		simplifier_state& state;
+		shared_simplifier_cache* cache;
+		expression::reference key;
+		const expression::reference& result;
+		const bool& is_simplified;
+		int exception_count = std::uncaught_exceptions();
+
+		scope_shared_cache_publish( simplifier_state& state, shared_simplifier_cache* cache, const expression::reference& key, 
+									const expression::reference& result, const bool& is_simplified )
+			: state( state ), cache( cache ), key( key ), result( result ), is_simplified( is_simplified ) {}
+
+		~scope_shared_cache_publish()
+		{
+			if ( state.is_speculative || state.max_depth != ~0ull || std::uncaught_exceptions() != exception_count )
+				return;
+			if ( cache )
+				cache->insert( key, result, is_simplified );
+			if ( impl::memo_enabled.load( std::memory_order_relaxed ) )
+				impl::record_memo( key, result, is_simplified );
+		}
+	};
 	void purge_simplifier_state() { if( local_state.init ) local_state->reset(); }
 
+	// Enables, disables or purges the shared cache, disabling it also releases the entries.
+	//
+	void set_shared_simplifier_cache( bool enabled )
+	{
+		if ( VTIL_SYMEX_SHARED_CACHE_SIZE == 0 )
+			return;
+		if ( !shared_simplifier_cache::enabled.exchange( enabled ) || enabled )
+			return;
+		shared_simplifier_cache::instance()->purge();
+	}
+	bool get_shared_simplifier_cache() 
+	{ 
+		return VTIL_SYMEX_SHARED_CACHE_SIZE != 0 && shared_simplifier_cache::enabled.load(); 
+	}
+	void purge_shared_simplifier_cache()
+	{
+		if ( get_shared_simplifier_cache() )
+			shared_simplifier_cache::instance()->purge();
+	}
+
 	simplifier_state_ptr swap_simplifier_state( simplifier_state_ptr p ) 
 	{ 
 		if ( p )
@@ -450,6 +669,31 @@ namespace vtil::symbolic
 	void simplifier_state_deleter::operator()( simplifier_state* p ) const noexcept { delete p; }
 	simplifier_state_ptr simplifier_state_allocator::operator()() const noexcept    { return { new simplifier_state, simplifier_state_deleter{} }; }
 
+	// Gets or sets the cache properties.
+	//
+	simplifier_cache_config get_simplifier_cache_config()                                                               { return thread_cache_config; }
+	simplifier_cache_config get_simplifier_cache_config( const simplifier_state_ptr& state )                            { return state->config; }
+	void set_simplifier_cache_config( const simplifier_cache_config& config )                                           { local_state->configure( config ); thread_cache_config = config; }
+	void set_simplifier_cache_config( const simplifier_state_ptr& state, const simplifier_cache_config& config )        { state->configure( config ); }
+
+	// Returns a snapshot of the cache statistics or resets them.
+	//
+	simplifier_cache_stats get_simplifier_cache_stats()                                                                 { return local_state->snapshot(); }
+	simplifier_cache_stats get_simplifier_cache_stats( const simplifier_state_ptr& state )                              { return state->snapshot(); }
+	void reset_simplifier_cache_stats()                                                                                 { local_state->stats = {}; }
+
+	// Conversion of the cache statistics to human-readable format.
+	//
+	std::string simplifier_cache_stats::to_string() const
+	{
+		return format::str(
+			"Lookups: %llu (%.2lf%% resolved) | Hits: %llu | Signature matches: %llu | Shared hits: %llu | Memo hits: %llu | Misses: %llu | "
+			"Prunes: %llu (%llu entries) | Entries: %llu / %llu",
+			lookups, hit_ratio() * 100, hits, signature_matches, shared_hits, memo_hits, misses,
+			prunes, pruned_entries, entries, config.max_entries
+		);
+	}
+
 
 	// Attempts to prettify the expression given.
 	//
@@ -484,7 +728,7 @@ namespace vtil::symbolic
 		
 		// Enumerate each pack descriptor:
 		//
-		for ( auto [dir_src, dir_dst] : get_pack_descriptors( exp->op )  )
+		for ( auto [dir_src, dir_dst] : get_pack_descriptors( exp->op ).match( exp )  )
 		{
 			// If we can transform the expression by the directive set:
 			//
@@ -581,7 +825,7 @@ namespace vtil::symbolic
 
 		// If complexity was higher or equal, fail.
 		//
-		if ( exp_new->complexity >= exp->complexity ) return false;
+		if ( exp_new->complexity() >= exp->complexity() ) return false;
 		
 		// Apply and return.
 		//
@@ -649,6 +893,34 @@ namespace vtil::symbolic
 		auto [cache_entry, success_flag, found, entry] = lstate.lookup( exp );
 		simplifier_state::scope_reference _g{ lstate.scope, entry };
 
+		// If the local cache missed, try the shared cache.
+		//
+		auto* shared_cache = shared_simplifier_cache::get();
+		if ( !found && shared_cache )
+		{
+			if ( auto shared_entry = shared_cache->find( exp ) )
+			{
+				cache_entry = shared_entry->result;
+				success_flag = shared_entry->is_simplified;
+				found = true;
+				lstate.stats.shared_hits++;
+			}
+		}
+
+		// If both missed, try the persistent memo.
+		//
+		if ( !found && impl::memo_enabled.load( std::memory_order_relaxed ) )
+		{
+			if ( auto memo_entry = impl::lookup_memo( exp ) )
+			{
+				std::tie( cache_entry, success_flag ) = *memo_entry;
+				found = true;
+				lstate.stats.memo_hits++;
+			}
+		}
+		if ( !found )
+			lstate.stats.misses++;
+
 		// If we resolved a valid cache entry:
 		//
 		if ( found )
@@ -669,6 +941,10 @@ namespace vtil::symbolic
 			return false;
 		}
 
+		// Share the result once we're done.
+		//
+		scope_shared_cache_publish _p{ lstate, shared_cache, exp, cache_entry, success_flag };
+
 		// If trying to simplify resizing:
 		//
 		if ( exp->op == math::operator_id::ucast ||
@@ -701,7 +977,7 @@ namespace vtil::symbolic
 			{
 				// If operand was simplified or if the complexity reduced, indicate success. 
 				//
-				if ( simplified || exp_new->complexity < exp->complexity )
+				if ( simplified || exp_new->complexity() < exp->complexity() )
 				{
 					exp = exp_new;
 					success_flag = true;
@@ -780,7 +1056,7 @@ namespace vtil::symbolic
 
 		// Enumerate each universal simplifier:
 		//
-		for ( auto& [dir_src, dir_dst] : get_universal_simplifiers( exp->op ) )
+		for ( auto& [dir_src, dir_dst] : get_universal_simplifiers( exp->op ).match( exp ) )
 		{
 			// If we can transform the expression by the directive set:
 			//
@@ -807,7 +1083,7 @@ namespace vtil::symbolic
 		{
 			// Enumerate each universal simplifier:
 			//
-			for ( auto& [dir_src, dir_dst] : get_boolean_simplifiers( exp->op ) )
+			for ( auto& [dir_src, dir_dst] : get_boolean_simplifiers( exp->op ).match( exp ) )
 			{
 				// If we can transform the expression by the directive set:
 				//
@@ -837,7 +1113,7 @@ namespace vtil::symbolic
 			{
 				// If complexity was reduced already, pass.
 				//
-				if ( exp_new->complexity < exp->complexity )
+				if ( exp_new->complexity() < exp->complexity() )
 					return true;
 
 				// Try simplifying with maximum depth set as expression's
@@ -863,27 +1139,27 @@ namespace vtil::symbolic
 				{
 					lstate.join_speculative();
 					lstate.max_depth = ~0;
-					return exp_new->complexity < exp->complexity;
+					return exp_new->complexity() < exp->complexity();
 				}
 			}
 			else
 			{
 				// If complexity was reduced already, pass.
 				//
-				if ( exp_new->complexity < exp->complexity )
+				if ( exp_new->complexity() < exp->complexity() )
 					return true;
 
 				// Attempt simplifying with maximum depth decremented by one,
 				// fail if complexity was not reduced.
 				//
 				simplify_expression( exp_new, false );
-				return exp_new->complexity < exp->complexity;
+				return exp_new->complexity() < exp->complexity();
 			}
 		};
 
 		// Enumerate each join descriptor:
 		//
-		for ( auto& [dir_src, dir_dst] : get_join_descriptors( exp->op ) )
+		for ( auto& [dir_src, dir_dst] : get_join_descriptors( exp->op ).match( exp ) )
 		{
 			// If we can transform the expression by the directive set:
 			//
@@ -892,7 +1168,7 @@ namespace vtil::symbolic
 #if VTIL_SYMEX_SIMPLIFY_VERBOSE
 				log<CON_GRN>( "[Join] %s => %s\n", *dir_src, *dir_dst );
 				log<CON_GRN>( "= %s [By join directive]\n", *exp_new );
-				log<CON_YLW>( "Complexity: %lf => %lf\n", exp->complexity, exp_new->complexity );
+				log<CON_YLW>( "Complexity: %lf => %lf\n", exp->complexity(), exp_new->complexity() );
 #endif
 				// Recurse, set the hint and return the simplified instance.
 				//
@@ -911,7 +1187,7 @@ namespace vtil::symbolic
 		{
 			// Enumerate each join descriptor:
 			//
-			for ( auto& [dir_src, dir_dst] : get_boolean_joiners( exp->op ) )
+			for ( auto& [dir_src, dir_dst] : get_boolean_joiners( exp->op ).match( exp ) )
 			{
 				// If we can transform the expression by the directive set:
 				//
@@ -920,7 +1196,7 @@ namespace vtil::symbolic
 #if VTIL_SYMEX_SIMPLIFY_VERBOSE
 					log<CON_GRN>( "[Join] %s => %s\n", *dir_src, *dir_dst );
 					log<CON_GRN>( "= %s [By join directive]\n", *exp_new );
-					log<CON_YLW>( "Complexity: %lf => %lf\n", exp->complexity, exp_new->complexity );
+					log<CON_YLW>( "Complexity: %lf => %lf\n", exp->complexity(), exp_new->complexity() );
 #endif
 					// Recurse, set the hint and return the simplified instance.
 					//
@@ -940,12 +1216,12 @@ namespace vtil::symbolic
 		{
 			// Enumerate each unpack descriptor:
 			//
-			for ( auto& [dir_src, dir_dst] : get_unpack_descriptors( exp->op ) )
+			for ( auto& [dir_src, dir_dst] : get_unpack_descriptors( exp->op ).match( exp ) )
 			{
 				// If we can transform the expression by the directive set:
 				//
 				if ( auto exp_new = transform( exp, dir_src, dir_dst,
-					 [ & ] ( auto& exp_new ) { simplify_expression( exp_new, true ); return exp_new->complexity < exp->complexity; } ) )
+					 [ & ] ( auto& exp_new ) { simplify_expression( exp_new, true ); return exp_new->complexity() < exp->complexity(); } ) )
 				{
 #if VTIL_SYMEX_SIMPLIFY_VERBOSE
 					log<CON_YLW>( "[Unpack] %s => %s\n", *dir_src, *dir_dst );
@@ -976,10 +1252,148 @@ namespace vtil::symbolic
 		return false;
 	}
 
+	// Counter the simplifier invocations made by the current task are added to.
+	//
+	static task_context_local( std::atomic<size_t>* ) invocation_counter = nullptr;
+	std::atomic<size_t>* set_simplifier_invocation_counter( std::atomic<size_t>* counter ) { return std::exchange( *invocation_counter, counter ); }
+
 	// Simple routine wrapping real simplification to instrument it for any reason when needed.
 	//
 	bool simplify_expression( expression::reference& exp, bool pretty, bool unpack )
 	{
+		if ( auto* counter = *invocation_counter )
+			counter->fetch_add( 1, std::memory_order::relaxed );
+		if ( impl::saturation_selected.load( std::memory_order::relaxed ) && !impl::saturation_depth )
+			return simplify_expression_saturated( exp, pretty );
 		return simplify_expression_i( exp, pretty, unpack );
 	}
+
+	// Enumerates the simplifier directives that can structurally match the expression in the
+	// order the greedy simplifier tries them, used as the rewrite rules of the saturation engine.
+	//
+	void impl::enumerate_simplifier_directives( const expression& exp, const std::function<void( const directive::instance*, const directive::instance* )>& fn )
+	{
+		for ( auto* table : { &get_universal_simplifiers( exp.op ), &get_join_descriptors( exp.op ),
+							  &get_unpack_descriptors( exp.op ), &get_pack_descriptors( exp.op ) } )
+		{
+			for ( auto& [dir_src, dir_dst] : table->match( exp ) )
+				fn( dir_src, dir_dst );
+		}
+		if ( exp.size() == 1 )
+		{
+			for ( auto* table : { &get_boolean_simplifiers( exp.op ), &get_boolean_joiners( exp.op ) } )
+			{
+				for ( auto& [dir_src, dir_dst] : table->match( exp ) )
+					fn( dir_src, dir_dst );
+			}
+		}
+	}
+
+	// Returns a tag identifying the set of simplifier directives, computed from their textual form.
+	//
+	uint64_t impl::get_directive_set_tag()
+	{
+		static const uint64_t tag = [ ] ()
+		{
+			hash_t hash = {};
+			auto append = [ & ] ( const auto& table )
+			{
+				hash = combine_hash( hash, make_hash( std::size( table ) ) );
+				for ( auto& [dir_src, dir_dst] : table )
+					hash = combine_hash( hash, make_hash( dir_src.to_string(), dir_dst.to_string() ) );
+			};
+			append( directive::universal_simplifiers );
+			append( directive::join_descriptors );
+			append( directive::pack_descriptors );
+			append( directive::unpack_descriptors );
+			append( directive::build_boolean_simplifiers() );
+			append( directive::boolean_joiners );
+			return hash.as64();
+		}();
+		return tag;
+	}
+
+	// Simplifies each unique node of the expression DAG given bottom-up exactly once, results
+	// are recorded in [visited] keyed by the original node.
+	//
+	static const expression::reference& simplify_shared_node( const expression::reference& exp, bool unpack,
+															  std::unordered_map<const expression*, expression::reference>& visited )
+	{
+		// If already visited, return the previous result.
+		//
+		// Recursion may rehash the map which invalidates the iterator, so the entry is
+		// referred to by reference from here on, references are stable across rehashes.
+		//
+		auto [it, inserted] = visited.try_emplace( exp.get(), exp );
+		expression::reference& entry = it->second;
+		if ( !inserted )
+			return entry;
+
+		// If not an expression or simplified already, there is nothing to do.
+		//
+		if ( !exp->is_expression() || exp->simplify_hint )
+			return entry;
+
+		// Resolve the simplified operands, rebuild the node if any of them changed.
+		//
+		expression::reference result = exp;
+		bool changed = false;
+		for ( auto* op_ptr : { &exp->lhs, &exp->rhs } )
+		{
+			if ( !op_ptr->is_valid() )
+				continue;
+			const expression::reference& op_new = simplify_shared_node( *op_ptr, unpack, visited );
+			if ( op_new.get() != op_ptr->get() )
+			{
+				( op_ptr == &exp->lhs ? ( +result )->lhs : ( +result )->rhs ) = op_new;
+				changed = true;
+			}
+		}
+		if ( changed )
+			( +result )->update( false );
+
+		// Simplify the node itself, operands are already marked simplified so this does not recurse
+		// into the shared parts again.
+		//
+		simplify_expression( result, false, unpack );
+		result->simplify_hint = true;
+
+		// Record the result.
+		//
+		entry = std::move( result );
+		return entry;
+	}
+
+	// Simplifies each expression in the given set, sharing the work across common subexpressions,
+	// returns the number of expressions that were changed.
+	//
+	size_t simplify_expressions( std::span<expression::reference> exps, bool pretty, bool unpack )
+	{
+		std::unordered_map<const expression*, expression::reference> visited;
+		visited.reserve( exps.size() * 8 );
+
+		size_t changed = 0;
+		for ( auto& exp : exps )
+		{
+			if ( !exp.is_valid() )
+				continue;
+
+			// Clear lazy if not done.
+			//
+			if ( exp->is_lazy )
+				( +exp )->is_lazy = false;
+
+			// Replace with the shared result, prettify if requested.
+			//
+			expression::reference result = simplify_shared_node( exp, unpack, visited );
+			if ( pretty )
+				simplify_expression( result, true, unpack );
+			if ( result.get() != exp.get() )
+			{
+				exp = std::move( result );
+				changed++;
+			}
+		}
+		return changed;
+	}
 };
\ No newline at end of file
@@ -27,8 +27,11 @@
 //
 #pragma once
 #include <iterator>
+#include <atomic>
 #include <unordered_map>
 #include <memory>
+#include <span>
+#include <filesystem>
 #include "../expressions/expression.hpp"
 
 // [Configuration]
@@ -38,6 +41,17 @@
 	#define VTIL_SYMEX_SIMPLIFY_VERBOSE 0
 #endif
 
+// [Configuration]
+// Determine the default properties of the thread-local LRU cache, can be changed at runtime
+// with ::set_simplifier_cache_config.
+//
+#ifndef VTIL_SYMEX_LRU_CACHE_SIZE
+	#define VTIL_SYMEX_LRU_CACHE_SIZE   0x10000
+#endif
+#ifndef VTIL_SYMEX_LRU_PRUNE_COEFF
+	#define VTIL_SYMEX_LRU_PRUNE_COEFF  0.35
+#endif
+
 namespace vtil::symbolic
 {
 	struct simplifier_state;
@@ -54,16 +68,101 @@ namespace vtil::symbolic
 		simplifier_state_ptr operator()() const noexcept;
 	};
 
+	// Properties of a simplifier cache, once the cache reaches [max_entries] entries, the least 
+	// recently used [max_entries x prune_coefficient] entries are evicted.
+	//
+	struct simplifier_cache_config
+	{
+		size_t max_entries = VTIL_SYMEX_LRU_CACHE_SIZE;
+		double prune_coefficient = VTIL_SYMEX_LRU_PRUNE_COEFF;
+	};
+
+	// Statistics of a simplifier cache.
+	//
+	struct simplifier_cache_stats
+	{
+		// Number of lookups made and the way they were resolved.
+		//
+		size_t lookups = 0;
+		size_t hits = 0;
+		size_t signature_matches = 0;
+		size_t shared_hits = 0;
+		size_t memo_hits = 0;
+		size_t misses = 0;
+
+		// Number of times the cache was pruned and the entries evicted by it.
+		//
+		size_t prunes = 0;
+		size_t pruned_entries = 0;
+
+		// Current state of the cache.
+		//
+		size_t entries = 0;
+		simplifier_cache_config config = {};
+
+		// Ratio of lookups resolved without simplification.
+		//
+		double hit_ratio() const { return lookups ? double( hits + signature_matches + shared_hits + memo_hits ) / lookups : 0.0; }
+
+		// Conversion to human-readable format.
+		//
+		std::string to_string() const;
+	};
+
 	// Attempts to simplify the expression given, returns whether the simplification
 	// succeeded or not.
 	//
 	bool simplify_expression( expression::reference& exp, bool pretty = false, bool unpack = true );
 
+	// Simplifies each expression in the given set, subexpressions shared between them are 
+	// simplified only once. Returns the number of expressions that were changed.
+	//
+	size_t simplify_expressions( std::span<expression::reference> exps, bool pretty = false, bool unpack = true );
+
 	// Purges the current thread's simplifier cache.
 	//
 	void purge_simplifier_state();
 
+	// Enables or disables the simplifier cache shared across threads, disabled by default since its
+	// entries outlive the routines they were created from. Purging releases every entry it holds and
+	// is done whenever a routine is destroyed.
+	//
+	void set_shared_simplifier_cache( bool enabled );
+	bool get_shared_simplifier_cache();
+	void purge_shared_simplifier_cache();
+
 	// Swaps the current thread's simplifier cache.
 	//
 	simplifier_state_ptr swap_simplifier_state( simplifier_state_ptr p = nullptr );
+
+	// Gets or sets the cache properties of the current thread's simplifier or the detached state given,
+	// shrinking the cache evicts the least recently used entries immediately. Properties set for the
+	// current thread are also inherited by every state created on it afterwards.
+	//
+	simplifier_cache_config get_simplifier_cache_config();
+	simplifier_cache_config get_simplifier_cache_config( const simplifier_state_ptr& state );
+	void set_simplifier_cache_config( const simplifier_cache_config& config );
+	void set_simplifier_cache_config( const simplifier_state_ptr& state, const simplifier_cache_config& config );
+
+	// Returns a snapshot of the cache statistics of the current thread's simplifier or the detached
+	// state given, or resets the counters.
+	//
+	simplifier_cache_stats get_simplifier_cache_stats();
+	simplifier_cache_stats get_simplifier_cache_stats( const simplifier_state_ptr& state );
+	void reset_simplifier_cache_stats();
+
+	// Sets the counter the simplifier invocations made by the current task are added to, null 
+	// disables counting, returns the previous counter.
+	//
+	std::atomic<size_t>* set_simplifier_invocation_counter( std::atomic<size_t>* counter );
+
+	// Loads the persistent simplifier memo from the file given and starts recording new results,
+	// returns false if the file could not be parsed. Expressions are stored with their variables
+	// replaced by placeholders so that the results are reusable across runs.
+	//
+	bool load_simplifier_memo( const std::filesystem::path& path );
+
+	// Appends the results recorded since the load into the file given.
+	//
+	bool save_simplifier_memo( const std::filesystem::path& path );
 };
\ No newline at end of file
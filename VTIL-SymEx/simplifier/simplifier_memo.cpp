@@ -0,0 +1,571 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of VTIL Project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software 
+//    without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#include "simplifier_memo.hpp"
+#include "simplifier.hpp"
+#include <vtil/io>
+#include <vtil/utility>
+#include <fstream>
+#include <sstream>
+#include <shared_mutex>
+#include <mutex>
+#include <unordered_set>
+
+namespace vtil::symbolic
+{
+	// File header of the memo, followed by the tag of the directive set it was built with.
+	//
+	static constexpr char memo_magic[ 8 ] = { 'V', 'T', 'I', 'L', 'M', 'E', 'M', 'O' };
+	static constexpr uint32_t memo_version = 2;
+
+	// Each record is prefixed with its length so that records that fail to parse can be skipped,
+	// records larger than the limit are assumed to be the result of corruption.
+	//
+	static constexpr uint32_t memo_max_record_size = 1 << 20;
+
+	// Expression node kinds as stored in the memo.
+	//
+	enum class memo_node : uint8_t
+	{
+		null,
+		constant,
+		variable,
+		unary,
+		binary,
+	};
+
+	// Placeholder variables replacing the original ones during normalization, a distinct identifier
+	// type so that they never compare equal to any variable of the expressions being simplified.
+	//
+	struct memo_placeholder
+	{
+		uint8_t index;
+
+		hash_t hash() const { return make_hash( 0x4f4d454d4c495456ull, index ); }
+		std::string to_string() const { return format::str( "memo$%u", index ); }
+		auto operator<=>( const memo_placeholder& ) const = default;
+	};
+	static expression::reference make_placeholder( size_t index, bitcnt_t size )
+	{
+		return expression{ unique_identifier{ memo_placeholder{ uint8_t( index ) } }, size }.make_lazy();
+	}
+
+	// Rebuilds the expression without invoking the simplifier, replacing every variable with 
+	// the result of the functor given, returns null if the functor fails for any variable.
+	//
+	template<typename F>
+	static expression::reference rebuild( const expression::reference& exp, F&& variable )
+	{
+		if ( exp->is_variable() )
+			return variable( exp );
+		if ( exp->is_constant() )
+			return expression{ exp->value.known_one(), exp->size() }.make_lazy();
+
+		expression::reference rhs = rebuild( exp->rhs, variable );
+		if ( !rhs ) return nullptr;
+		if ( !exp->lhs )
+			return expression{ exp->op, std::move( rhs ) };
+
+		expression::reference lhs = rebuild( exp->lhs, variable );
+		if ( !lhs ) return nullptr;
+		return expression{ std::move( lhs ), exp->op, std::move( rhs ) };
+	}
+
+	// Hash of the shape of the expression, ignoring the identity of the variables, so that it is
+	// equal for an expression and its normalized form. Nodes of known value are hashed as constants
+	// since the normalization folds them, and operands of commutative operators are unordered as
+	// with the expression hash.
+	//
+	static hash_t shape_hash( const expression::reference& exp )
+	{
+		if ( exp->value.is_known() )
+			return make_hash( exp->value.known_one(), uint8_t( exp->size() ) );
+		if ( exp->is_variable() )
+			return make_hash( uint8_t( exp->size() ) );
+
+		hash_t base;
+		if ( !exp->lhs )                              base = shape_hash( exp->rhs );
+		else if ( exp->get_op_desc().is_commutative ) base = combine_unordered_hash( shape_hash( exp->lhs ), shape_hash( exp->rhs ) );
+		else                                          base = combine_hash( shape_hash( exp->lhs ), shape_hash( exp->rhs ) );
+		return combine_hash( base, make_hash( exp->op ) );
+	}
+
+	// Expression with every variable replaced with a positional placeholder.
+	//
+	struct normalized_expression
+	{
+		expression::reference exp;
+		std::vector<expression::reference> variables;
+
+		normalized_expression( const expression::reference& input )
+		{
+			exp = rebuild( input, [ & ] ( const expression::reference& var ) -> expression::reference
+			{
+				auto it = std::find_if( variables.begin(), variables.end(), [ & ] ( auto& v ) { return v->uid == var->uid && v->size() == var->size(); } );
+				if ( it == variables.end() )
+				{
+					if ( variables.size() == 256 )
+						return nullptr;
+					it = variables.insert( it, var );
+				}
+				return make_placeholder( it - variables.begin(), var->size() );
+			} );
+			if ( exp ) ( +exp )->is_lazy = false;
+		}
+
+		// Normalizes another expression with the same placeholders, returns null if it references
+		// a variable that is not in the original expression.
+		//
+		expression::reference normalize( const expression::reference& value ) const
+		{
+			auto result = rebuild( value, [ & ] ( const expression::reference& var ) -> expression::reference
+			{
+				for ( auto [original, idx] : zip( variables, iindices ) )
+					if ( original->uid == var->uid && original->size() == var->size() )
+						return make_placeholder( idx, var->size() );
+				return nullptr;
+			} );
+			if ( result ) ( +result )->is_lazy = false;
+			return result;
+		}
+
+		// Maps an expression normalized with the same placeholders back to the original variables.
+		//
+		expression::reference denormalize( const expression::reference& value ) const
+		{
+			auto result = rebuild( value, [ & ] ( const expression::reference& var ) -> expression::reference
+			{
+				if ( !var->uid->value.is<memo_placeholder>() )
+					return nullptr;
+				size_t index = var->uid.get<memo_placeholder>().index;
+				return index < variables.size() ? variables[ index ] : nullptr;
+			} );
+			if ( result ) ( +result )->is_lazy = false;
+			return result;
+		}
+	};
+
+	// Memo entry, stored in normalized form.
+	//
+	struct memo_entry
+	{
+		expression::reference input;
+		expression::reference output;
+		bool is_simplified;
+	};
+
+	// Records made by a single thread that are not yet merged into the memo, kept in their original
+	// form so that neither the normalization nor the memo lock is on the path of the simplifier.
+	// The records left in the buffer of an exiting thread are handed over to the memo as is.
+	//
+	struct memo_buffer
+	{
+		std::mutex lock;
+		std::vector<memo_entry> records;
+
+		memo_buffer();
+		~memo_buffer();
+	};
+
+	// Global memo state.
+	//
+	struct memo_state
+	{
+		std::shared_mutex lock;
+		std::unordered_multimap<uint64_t, memo_entry> entries;
+		std::vector<memo_entry> pending;
+
+		// Shapes of the entries, checked before normalizing an expression to look it up.
+		//
+		std::unordered_set<uint64_t> shapes;
+
+		// Inserts the entry if not already present, returns false if it was.
+		//
+		bool insert( const memo_entry& entry )
+		{
+			if ( find( entry.input ) )
+				return false;
+			entries.emplace( entry.input->hash().as64(), entry );
+			shapes.insert( shape_hash( entry.input ).as64() );
+			return true;
+		}
+
+		// Buffers of every thread that recorded a result and the records of the exited threads.
+		//
+		std::mutex buffers_lock;
+		std::vector<memo_buffer*> buffers;
+		std::vector<memo_entry> orphaned;
+
+		const memo_entry* find( const expression::reference& exp ) const
+		{
+			auto [it, end] = entries.equal_range( exp->hash().as64() );
+			for ( ; it != end; ++it )
+				if ( it->second.input->is_identical( *exp ) )
+					return &it->second;
+			return nullptr;
+		}
+
+		// Normalizes the records given and merges them into the memo.
+		//
+		void merge( std::vector<memo_entry>& records )
+		{
+			std::vector<memo_entry> normalized;
+			normalized.reserve( records.size() );
+			for ( auto& record : records )
+			{
+				// Normalize both sides with the same placeholders, skip if the result 
+				// references a variable that's not in the input.
+				//
+				normalized_expression normal{ record.input };
+				if ( !normal.exp )
+					continue;
+				expression::reference output = nullptr;
+				if ( record.output && !( output = normal.normalize( record.output ) ) )
+					continue;
+				normalized.push_back( { std::move( normal.exp ), std::move( output ), record.is_simplified } );
+			}
+			records.clear();
+
+			std::unique_lock _g{ lock };
+			for ( auto& entry : normalized )
+			{
+				if ( entries.size() >= VTIL_SYMEX_MEMO_MAX_ENTRIES )
+					break;
+				if ( insert( entry ) )
+					pending.emplace_back( std::move( entry ) );
+			}
+		}
+
+		// Merges the records buffered by every thread.
+		//
+		void flush()
+		{
+			std::lock_guard _g{ buffers_lock };
+			std::vector<memo_entry> records = std::move( orphaned );
+			merge( records );
+			for ( memo_buffer* buffer : buffers )
+			{
+				{
+					std::lock_guard _b{ buffer->lock };
+					records.swap( buffer->records );
+				}
+				merge( records );
+			}
+		}
+
+		// Returns the global instance, intentionally leaked to avoid destroying the
+		// expressions after the allocators are gone.
+		//
+		static memo_state& get()
+		{
+			static memo_state* instance = new memo_state();
+			return *instance;
+		}
+	};
+
+	// Buffers register themselves to the memo and hand over the leftover records on destruction.
+	//
+	memo_buffer::memo_buffer()
+	{
+		auto& memo = memo_state::get();
+		std::lock_guard _g{ memo.buffers_lock };
+		memo.buffers.push_back( this );
+	}
+	memo_buffer::~memo_buffer()
+	{
+		auto& memo = memo_state::get();
+		std::lock_guard _g{ memo.buffers_lock };
+		std::erase( memo.buffers, this );
+		std::lock_guard _b{ lock };
+		memo.orphaned.insert( memo.orphaned.end(), std::make_move_iterator( records.begin() ), std::make_move_iterator( records.end() ) );
+		records.clear();
+	}
+	static thread_local memo_buffer local_buffer;
+
+	// Serialization of the normalized expressions.
+	//
+	static void write_node( std::ostream& out, const expression::reference& exp )
+	{
+		auto write = [ & ] ( auto value ) { out.write( ( const char* ) &value, sizeof( value ) ); };
+
+		if ( !exp )
+		{
+			write( memo_node::null );
+		}
+		else if ( exp->is_constant() )
+		{
+			write( memo_node::constant );
+			write( uint8_t( exp->size() ) );
+			write( exp->value.known_one() );
+		}
+		else if ( exp->is_variable() )
+		{
+			write( memo_node::variable );
+			write( uint8_t( exp->size() ) );
+			write( exp->uid.get<memo_placeholder>().index );
+		}
+		else
+		{
+			write( exp->lhs ? memo_node::binary : memo_node::unary );
+			write( exp->op );
+			if ( exp->lhs ) write_node( out, exp->lhs );
+			write_node( out, exp->rhs );
+		}
+	}
+	static std::optional<expression::reference> read_node( std::istream& in, size_t depth = 0 )
+	{
+		auto read = [ & ] <typename T> ( T& value ) { return ( bool ) in.read( ( char* ) &value, sizeof( T ) ); };
+
+		memo_node kind;
+		if ( depth > 512 || !read( kind ) )
+			return std::nullopt;
+
+		switch ( kind )
+		{
+			case memo_node::null:
+				return expression::reference{ nullptr };
+			case memo_node::constant:
+			{
+				uint8_t size;
+				uint64_t value;
+				if ( !read( size ) || !read( value ) || !size || size > 64 ) 
+					return std::nullopt;
+				return expression{ value, size }.make_lazy();
+			}
+			case memo_node::variable:
+			{
+				uint8_t size, index;
+				if ( !read( size ) || !read( index ) || !size || size > 64 )
+					return std::nullopt;
+				return make_placeholder( index, size );
+			}
+			case memo_node::unary:
+			case memo_node::binary:
+			{
+				math::operator_id op;
+				if ( !read( op ) || op <= math::operator_id::invalid || op >= math::operator_id::max )
+					return std::nullopt;
+
+				std::optional<expression::reference> lhs;
+				if ( kind == memo_node::binary && !( lhs = read_node( in, depth + 1 ) ) )
+					return std::nullopt;
+				auto rhs = read_node( in, depth + 1 );
+				if ( !rhs || !*rhs || ( lhs && !*lhs ) )
+					return std::nullopt;
+
+				if ( lhs )
+					return expression{ std::move( *lhs ), op, std::move( *rhs ) };
+				else
+					return expression{ op, std::move( *rhs ) };
+			}
+			default:
+				return std::nullopt;
+		}
+	}
+
+	// Serialization of the records, a record is only valid if it is consumed entirely.
+	//
+	static void write_record( std::ostream& out, const memo_entry& entry )
+	{
+		std::ostringstream record;
+		uint8_t is_simplified = entry.is_simplified;
+		record.write( ( const char* ) &is_simplified, 1 );
+		write_node( record, entry.input );
+		write_node( record, entry.output );
+
+		std::string payload = record.str();
+		uint32_t length = uint32_t( payload.size() );
+		out.write( ( const char* ) &length, sizeof( length ) );
+		out.write( payload.data(), payload.size() );
+	}
+	static std::optional<memo_entry> read_record( const std::string& payload )
+	{
+		std::istringstream in( payload );
+		uint8_t is_simplified;
+		if ( !in.read( ( char* ) &is_simplified, 1 ) || is_simplified > 1 )
+			return std::nullopt;
+		auto input = read_node( in );
+		auto output = read_node( in );
+		if ( !input || !output || !*input || in.peek() != EOF )
+			return std::nullopt;
+
+		( +*input )->is_lazy = false;
+		if ( *output ) ( +*output )->is_lazy = false;
+		return memo_entry{ std::move( *input ), std::move( *output ), is_simplified != 0 };
+	}
+
+	// Serialization of the header.
+	//
+	static void write_header( std::ostream& out )
+	{
+		uint64_t tag = impl::get_directive_set_tag();
+		out.write( memo_magic, sizeof( memo_magic ) );
+		out.write( ( const char* ) &memo_version, sizeof( memo_version ) );
+		out.write( ( const char* ) &tag, sizeof( tag ) );
+	}
+	static bool read_header( std::istream& in )
+	{
+		char magic[ sizeof( memo_magic ) ];
+		uint32_t version;
+		uint64_t tag;
+		return in.read( magic, sizeof( magic ) ) && !memcmp( magic, memo_magic, sizeof( magic ) ) &&
+			   in.read( ( char* ) &version, sizeof( version ) ) && version == memo_version &&
+			   in.read( ( char* ) &tag, sizeof( tag ) ) && tag == impl::get_directive_set_tag();
+	}
+
+	namespace impl
+	{
+		std::optional<std::pair<expression::reference, bool>> lookup_memo( const expression::reference& exp )
+		{
+			if ( exp->depth < VTIL_SYMEX_MEMO_MIN_DEPTH )
+				return std::nullopt;
+
+			// Skip the normalization unless an entry of the same shape exists.
+			//
+			auto& memo = memo_state::get();
+			uint64_t shape = shape_hash( exp ).as64();
+			{
+				std::shared_lock _g{ memo.lock };
+				if ( !memo.shapes.contains( shape ) )
+					return std::nullopt;
+			}
+
+			normalized_expression normal{ exp };
+			if ( !normal.exp )
+				return std::nullopt;
+
+			std::shared_lock _g{ memo.lock };
+			if ( auto entry = memo.find( normal.exp ) )
+			{
+				if ( !entry->output )
+					return std::pair{ expression::reference{ nullptr }, entry->is_simplified };
+				if ( auto output = normal.denormalize( entry->output ) )
+				{
+					output->simplify_hint = true;
+					return std::pair{ std::move( output ), entry->is_simplified };
+				}
+			}
+			return std::nullopt;
+		}
+
+		void record_memo( const expression::reference& exp, const expression::reference& result, bool is_simplified )
+		{
+			if ( exp->depth < VTIL_SYMEX_MEMO_MIN_DEPTH || ( is_simplified && !result ) )
+				return;
+
+			// Buffer the record, merge the buffer into the memo once it is full.
+			//
+			std::vector<memo_entry> records;
+			{
+				std::lock_guard _g{ local_buffer.lock };
+				local_buffer.records.push_back( { exp, result, is_simplified } );
+				if ( local_buffer.records.size() < VTIL_SYMEX_MEMO_BATCH_SIZE )
+					return;
+				records.swap( local_buffer.records );
+			}
+			memo_state::get().merge( records );
+		}
+	};
+
+	// Loads the persistent simplifier memo from the file given and starts recording new results,
+	// returns false if the file could not be parsed or was built with a different directive set.
+	//
+	bool load_simplifier_memo( const std::filesystem::path& path )
+	{
+		auto& memo = memo_state::get();
+
+		// If the file does not exist, start with an empty memo.
+		//
+		std::ifstream in( path, std::ios::binary );
+		if ( !in )
+		{
+			impl::memo_enabled = true;
+			return true;
+		}
+
+		// Validate the header.
+		//
+		if ( !read_header( in ) )
+			return false;
+
+		// Read every record, skipping the ones that fail to parse. Reading stops at a truncated 
+		// record or an invalid length since the next record cannot be located.
+		//
+		std::vector<memo_entry> loaded;
+		while ( in.peek() != EOF )
+		{
+			uint32_t length;
+			if ( !in.read( ( char* ) &length, sizeof( length ) ) || length > memo_max_record_size )
+				break;
+			std::string payload( length, '\0' );
+			if ( !in.read( payload.data(), length ) )
+				break;
+			if ( auto entry = read_record( payload ) )
+				loaded.emplace_back( std::move( *entry ) );
+		}
+
+		// Insert the entries and start recording.
+		//
+		{
+			std::unique_lock _g{ memo.lock };
+			for ( auto& entry : loaded )
+			{
+				if ( memo.entries.size() >= VTIL_SYMEX_MEMO_MAX_ENTRIES )
+					break;
+				memo.insert( entry );
+			}
+		}
+		impl::memo_enabled = true;
+		return true;
+	}
+
+	// Appends the results recorded since the load into the file given, the file is rewritten if
+	// it was built with a different directive set.
+	//
+	bool save_simplifier_memo( const std::filesystem::path& path )
+	{
+		auto& memo = memo_state::get();
+		memo.flush();
+		std::unique_lock _g{ memo.lock };
+
+		bool append = false;
+		if ( std::ifstream in{ path, std::ios::binary } )
+			append = read_header( in );
+		std::ofstream out( path, std::ios::binary | ( append ? std::ios::app : std::ios::trunc ) );
+		if ( !out )
+			return false;
+
+		if ( !append )
+			write_header( out );
+		for ( auto& entry : memo.pending )
+			write_record( out, entry );
+		if ( !out )
+			return false;
+		memo.pending.clear();
+		return true;
+	}
+};
@@ -0,0 +1,72 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project   
+// All rights reserved.   
+//    
+// Redistribution and use in source and binary forms, with or without   
+// modification, are permitted provided that the following conditions are met: 
+//    
+// 1. Redistributions of source code must retain the above copyright notice,   
+//    this list of conditions and the following disclaimer.   
+// 2. Redistributions in binary form must reproduce the above copyright   
+//    notice, this list of conditions and the following disclaimer in the   
+//    documentation and/or other materials provided with the distribution.   
+// 3. Neither the name of VTIL Project nor the names of its contributors
+//    may be used to endorse or promote products derived from this software 
+//    without specific prior written permission.   
+//    
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE   
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE  
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE   
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR   
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF   
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS   
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN   
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)   
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE  
+// POSSIBILITY OF SUCH DAMAGE.        
+//
+#pragma once
+#include <optional>
+#include <utility>
+#include "../expressions/expression.hpp"
+
+// [Configuration]
+// Determine the minimum depth of the expressions recorded in the persistent simplifier memo
+// and the maximum number of entries it can hold.
+//
+#ifndef VTIL_SYMEX_MEMO_MIN_DEPTH
+	#define VTIL_SYMEX_MEMO_MIN_DEPTH               2
+#endif
+#ifndef VTIL_SYMEX_MEMO_MAX_ENTRIES
+	#define VTIL_SYMEX_MEMO_MAX_ENTRIES             0x100000
+#endif
+
+// Determine the number of records each thread buffers before merging them into the memo.
+//
+#ifndef VTIL_SYMEX_MEMO_BATCH_SIZE
+	#define VTIL_SYMEX_MEMO_BATCH_SIZE              256
+#endif
+
+// Internal interface between the simplifier and the persistent memo, see 
+// load_simplifier_memo and save_simplifier_memo for the public interface.
+//
+namespace vtil::symbolic::impl
+{
+	// Set once a memo is loaded, no lookups or records are made otherwise.
+	//
+	inline std::atomic<bool> memo_enabled = false;
+
+	// Looks up the expression in the memo, returns [<result>, <simplified?>] if found.
+	//
+	std::optional<std::pair<expression::reference, bool>> lookup_memo( const expression::reference& exp );
+
+	// Records the result of a simplification into the memo, records are buffered per thread and
+	// merged in batches, and on ::save_simplifier_memo.
+	//
+	void record_memo( const expression::reference& exp, const expression::reference& result, bool is_simplified );
+
+	// Returns a tag identifying the set of simplifier directives, a memo built with a different 
+	// set is rejected.
+	//
+	uint64_t get_directive_set_tag();
+};
@@ -0,0 +1,204 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+// 3. Neither the name of VTIL nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include "doctest.h"
+#include <vtil/vtil>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <set>
+
+using namespace vtil;
+
+namespace
+{
+	// Pass recording whether any block was processed while one of its neighbours was.
+	//
+	template<optimizer::execution_order order>
+	struct adjacency_probe : optimizer::pass_interface<order>
+	{
+		std::unordered_map<const basic_block*, std::atomic<bool>> running;
+		std::atomic<size_t> processed = { 0 };
+		std::atomic<size_t> conflicts = { 0 };
+
+		adjacency_probe( const routine* rtn )
+		{
+			for ( auto& [vip, block] : rtn->explored_blocks )
+				running[ block ];
+		}
+
+		size_t pass( basic_block* blk, bool xblock = false ) override
+		{
+			const auto check_neighbours = [ & ] ()
+			{
+				for ( auto* links : { &blk->next, &blk->prev } )
+					for ( auto* other : *links )
+						if ( other != blk && running.at( other ).load() )
+							conflicts++;
+			};
+
+			running.at( blk ) = true;
+			check_neighbours();
+			std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+			check_neighbours();
+			running.at( blk ) = false;
+			processed++;
+			return 0;
+		}
+	};
+
+	// Pass simplifying the same expression in every block, counting the simplifications that
+	// could not be resolved from the cache of the thread and the threads involved.
+	//
+	struct cache_probe : optimizer::pass_interface<optimizer::execution_order::parallel>
+	{
+		std::mutex lock;
+		std::set<std::thread::id> threads;
+		std::atomic<size_t> cold = { 0 };
+		std::atomic<size_t> warm = { 0 };
+
+		size_t pass( basic_block* blk, bool xblock = false ) override
+		{
+			{
+				std::lock_guard _g( lock );
+				threads.insert( std::this_thread::get_id() );
+			}
+
+			auto before = symbolic::get_simplifier_cache_stats();
+			symbolic::expression::reference x = symbolic::variable{ register_desc{ register_virtual, 1, 64 } }.to_expression();
+			symbolic::expression::reference exp = ( ( x + 0x1234 ) ^ ( x << 3 ) ) - ( x & 0xff );
+			auto after = symbolic::get_simplifier_cache_stats();
+
+			if ( after.misses != before.misses || after.shared_hits != before.shared_hits )
+				cold++;
+			else
+				warm++;
+			return 0;
+		}
+	};
+
+	// Runs the probe in both parallel depth orders and checks that no neighbours overlapped.
+	//
+	static void check_no_adjacent_overlap( routine* rtn )
+	{
+		adjacency_probe<optimizer::execution_order::parallel_bf> bf{ rtn };
+		bf( rtn );
+		CHECK( bf.conflicts == 0 );
+		CHECK( bf.processed != 0 );
+
+		adjacency_probe<optimizer::execution_order::parallel_df> df{ rtn };
+		df( rtn );
+		CHECK( df.conflicts == 0 );
+		CHECK( df.processed != 0 );
+	}
+};
+
+DOCTEST_TEST_CASE( "apply_pass: cross edges are ordered in parallel depth orders" )
+{
+	// E -> X -> A, E -> B, A -> B places A deeper than B while they are adjacent.
+	//
+	basic_block* entry = basic_block::begin( 0 );
+	std::unique_ptr<routine> rtn{ entry->owner };
+	basic_block* x = rtn->create_block( 1, entry ).first;
+	basic_block* a = rtn->create_block( 2, x ).first;
+	basic_block* b = rtn->create_block( 3, entry ).first;
+	rtn->create_block( 3, a );
+	( void ) b;
+
+	for ( int n = 0; n != 20; n++ )
+		check_no_adjacent_overlap( rtn.get() );
+}
+
+DOCTEST_TEST_CASE( "apply_pass: back and cross edges of random graphs are ordered" )
+{
+	std::mt19937_64 rng( 0x5041525045 );
+
+	for ( int round = 0; round != 20; round++ )
+	{
+		basic_block* entry = basic_block::begin( 0 );
+		std::unique_ptr<routine> rtn{ entry->owner };
+
+		size_t count = 2 + rng() % 64;
+		for ( vip_t vip = 1; vip != count; vip++ )
+		{
+			rtn->create_block( vip, rtn->get_block( rng() % vip ) );
+			if ( rng() % 3 == 0 )
+				rtn->create_block( rng() % ( vip + 1 ), rtn->get_block( rng() % ( vip + 1 ) ) );
+		}
+		check_no_adjacent_overlap( rtn.get() );
+	}
+}
+
+DOCTEST_TEST_CASE( "apply_pass: worker caches stay warm across blocks" )
+{
+	// Create a few routines switched to the worker caches.
+	//
+	std::vector<std::unique_ptr<routine>> routines;
+	for ( int n = 0; n != 8; n++ )
+	{
+		basic_block* entry = basic_block::begin( 0 );
+		for ( vip_t vip = 1; vip != 64; vip++ )
+			entry->owner->create_block( vip, entry->owner->get_block( vip - 1 ) );
+		entry->owner->context.get<optimizer::impl::worker_cache_tag>();
+		routines.emplace_back( entry->owner );
+	}
+
+	// Run the probe over each routine as a task the way apply_all_batch does, so that the
+	// blocks are mostly processed by threads waiting for their own routine. Each thread
+	// should only simplify the expression once.
+	//
+	cache_probe probe;
+	transform_parallel( routines, [ & ] ( const std::unique_ptr<routine>& rtn ) { probe( rtn.get() ); } );
+	CHECK( probe.cold + probe.warm == 8 * 64 );
+	CHECK( probe.cold <= probe.threads.size() );
+}
+
+DOCTEST_TEST_CASE( "apply_pass: per-block caches inherit the cache properties of the thread" )
+{
+	symbolic::simplifier_cache_config previous = symbolic::get_simplifier_cache_config();
+	symbolic::set_simplifier_cache_config( { .max_entries = 512, .prune_coefficient = 0.5 } );
+
+	basic_block* entry = basic_block::begin( 0 );
+	std::unique_ptr<routine> rtn{ entry->owner };
+
+	// The cache swapped in for the block and the one left after it is swapped out should both
+	// be configured as set for the thread.
+	//
+	{
+		optimizer::scope_simplifier_cache _s{ entry };
+		CHECK( symbolic::get_simplifier_cache_stats().config.max_entries == 512 );
+	}
+	CHECK( symbolic::get_simplifier_cache_stats().config.max_entries == 512 );
+
+	// So should the caches allocated or stolen from the thread.
+	//
+	CHECK( symbolic::get_simplifier_cache_config( symbolic::simplifier_state_allocator{}() ).max_entries == 512 );
+	CHECK( symbolic::get_simplifier_cache_config( symbolic::swap_simplifier_state() ).max_entries == 512 );
+	CHECK( symbolic::get_simplifier_cache_stats().config.max_entries == 512 );
+
+	symbolic::set_simplifier_cache_config( previous );
+}
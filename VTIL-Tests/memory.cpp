@@ -0,0 +1,116 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+// 3. Neither the name of VTIL nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include "doctest.h"
+#include <vtil/vtil>
+#include <random>
+
+using namespace vtil;
+using namespace vtil::symbolic;
+
+DOCTEST_TEST_CASE( "memory: indexed lookup matches the linear scan" )
+{
+	std::mt19937_64 rng( 0x594f4d454d );
+
+	// Pointer bases, a mix of stack, register, constant, composite and masked pointers.
+	//
+	const expression::reference bases[] = {
+		variable{ REG_SP }.to_expression(),
+		variable{ register_desc{ register_virtual, 1, 64 } }.to_expression(),
+		variable{ register_desc{ register_virtual, 2, 64 } }.to_expression(),
+		expression::reference{ 0x1000ull, 64 },
+		variable{ REG_SP }.to_expression() + variable{ register_desc{ register_virtual, 1, 64 } }.to_expression(),
+		variable{ REG_IMGBASE }.to_expression(),
+		variable{ register_desc{ register_virtual, 3, 64 } }.to_expression() & expression::reference{ 0xffull, 64 },
+	};
+	static constexpr bitcnt_t sizes[] = { 8, 16, 32, 64 };
+
+	// Passing a distance calculator disables the index and forces a scan of the whole store.
+	//
+	const auto linear = [ ] ( const pointer& a, const pointer& b ) { return memory::bit_distance( a, b ); };
+
+	// Serializes the store for comparison.
+	//
+	const auto dump = [ ] ( const memory& mem )
+	{
+		std::string result;
+		for ( auto& [ptr, value] : mem )
+			result += ptr.to_string() + " = " + value->to_string() + "\n";
+		return result;
+	};
+
+	for ( int round = 0; round != 200; round++ )
+	{
+		bool relaxed = rng() & 1;
+		memory indexed( relaxed ), scanned( relaxed );
+		size_t base_count = 1 + rng() % std::size( bases );
+
+		for ( int step = 0; step != 60; step++ )
+		{
+			pointer ptr = { bases[ rng() % base_count ] + int64_t( rng() % 40 ) - 20 };
+			bitcnt_t size = sizes[ rng() % std::size( sizes ) ];
+
+			switch ( rng() % 4 )
+			{
+				case 0:
+				{
+					expression::reference value = variable{ register_desc{ register_virtual, 100ull + step, size } }.to_expression();
+					CHECK( indexed.write( ptr, value ).has_value() == scanned.write( ptr, value, linear ).has_value() );
+					break;
+				}
+				case 1:
+				{
+					uint64_t indexed_contains = 0, scanned_contains = 0;
+					expression::reference a = indexed.read( ptr, size, free_form_iterator, &indexed_contains );
+					expression::reference b = scanned.read( ptr, size, free_form_iterator, &scanned_contains, linear );
+					REQUIRE( bool( a ) == bool( b ) );
+					if ( a )
+					{
+						CHECK( a->to_string() == b->to_string() );
+						CHECK( indexed_contains == scanned_contains );
+					}
+					break;
+				}
+				case 2:
+					CHECK( indexed.unknown_mask( ptr, size ) == scanned.unknown_mask( ptr, size, linear ) );
+					break;
+				case 3:
+					CHECK( indexed.known_mask( ptr, size ) == scanned.known_mask( ptr, size, linear ) );
+					break;
+			}
+
+			// Occasionally rebuild the index through a copy.
+			//
+			if ( rng() % 20 == 0 )
+			{
+				memory copy = indexed;
+				indexed = copy;
+			}
+			REQUIRE( dump( indexed ) == dump( scanned ) );
+		}
+	}
+}
@@ -0,0 +1,220 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+// 3. Neither the name of VTIL nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include "doctest.h"
+#include <vtil/vtil>
+#include <filesystem>
+#include <random>
+
+// Determine the path the sample routines are loaded from.
+//
+#ifndef VTIL_TESTS_SAMPLES
+	#define VTIL_TESTS_SAMPLES "../Sample Routines"
+#endif
+
+using namespace vtil;
+
+// Checks the reachability index of the routine against a traversal of the control flow graph
+// from every block, if not exact only checks that every path found is in the index.
+//
+static void check_reachability( const routine* rtn, bool exact = true )
+{
+	std::vector<const basic_block*> blocks;
+	for ( auto& [vip, block] : rtn->explored_blocks )
+		blocks.push_back( block );
+
+	std::map<const basic_block*, std::set<const basic_block*>> reachable;
+	for ( const basic_block* src : blocks )
+	{
+		auto& visited = reachable[ src ];
+		std::vector<const basic_block*> stack = { src };
+		while ( !stack.empty() )
+		{
+			const basic_block* block = stack.back();
+			stack.pop_back();
+			if ( visited.insert( block ).second )
+				stack.insert( stack.end(), block->next.begin(), block->next.end() );
+		}
+	}
+
+	if ( !exact )
+	{
+		size_t missing = 0;
+		for ( const basic_block* src : blocks )
+			for ( const basic_block* dst : reachable[ src ] )
+				missing += !rtn->has_path( src, dst );
+		CHECK( missing == 0 );
+		return;
+	}
+
+	for ( const basic_block* src : blocks )
+	{
+		bool looping = false;
+		for ( const basic_block* prev : src->prev )
+			looping |= reachable[ src ].contains( prev );
+		CHECK( rtn->is_looping( src ) == looping );
+
+		for ( const basic_block* dst : blocks )
+		{
+			bool expected = reachable[ src ].contains( dst );
+			if ( rtn->has_path( src, dst ) != expected )
+			{
+				DOCTEST_FAIL_CHECK( format::str( "has_path(%llx, %llx) != %d", src->entry_vip, dst->entry_vip, expected ) );
+				return;
+			}
+			if ( !expected )
+				continue;
+
+			// The path consists of the blocks reachable from the source that can reach the destination.
+			//
+			const block_set& path = rtn->get_path( src, dst );
+			size_t count = 0, mismatches = 0;
+			for ( const basic_block* block : blocks )
+			{
+				bool on_path = reachable[ src ].contains( block ) && reachable[ block ].contains( dst );
+				mismatches += path.contains( block ) != on_path;
+				count += on_path;
+			}
+			CHECK( mismatches == 0 );
+			CHECK( path.size() == count );
+		}
+	}
+}
+
+DOCTEST_TEST_CASE( "routine: reachability of the sample routines" )
+{
+	std::vector<std::filesystem::path> paths;
+	for ( auto& entry : std::filesystem::directory_iterator( VTIL_TESTS_SAMPLES ) )
+		if ( entry.path().extension() == ".vtil" )
+			paths.emplace_back( entry.path() );
+	std::sort( paths.begin(), paths.end() );
+	REQUIRE( !paths.empty() );
+
+	for ( auto& path : paths )
+	{
+		DOCTEST_CAPTURE( path );
+		std::unique_ptr<routine> rtn{ load_routine( path ) };
+		check_reachability( rtn.get() );
+
+		// Check again after the optimizer has merged and removed blocks.
+		//
+		optimizer::apply_all( rtn.get() );
+		check_reachability( rtn.get() );
+	}
+}
+
+DOCTEST_TEST_CASE( "routine: reachability of random control flow graphs" )
+{
+	std::mt19937_64 rng( 0x4854415048 );
+
+	for ( int round = 0; round != 50; round++ )
+	{
+		basic_block* entry = basic_block::begin( 0 );
+		std::unique_ptr<routine> rtn{ entry->owner };
+
+		// Grow a tree of blocks with random back and cross edges, holding onto some of the
+		// cached paths half way through.
+		//
+		size_t count = 2 + rng() % 200;
+		std::vector<std::tuple<const basic_block*, const basic_block*, const block_set*>> held;
+		for ( vip_t vip = 1; vip != count; vip++ )
+		{
+			basic_block* src = rtn->get_block( rng() % vip );
+			rtn->create_block( vip, src );
+			if ( rng() % 4 == 0 )
+				rtn->create_block( rng() % vip, rtn->get_block( vip ) );
+
+			if ( vip == count / 2 )
+			{
+				for ( int n = 0; n != 16; n++ )
+				{
+					const basic_block* a = rtn->get_block( rng() % ( vip + 1 ) );
+					const basic_block* b = rtn->get_block( rng() % ( vip + 1 ) );
+					if ( rtn->has_path( a, b ) )
+						held.emplace_back( a, b, &rtn->get_path( a, b ) );
+				}
+			}
+		}
+		check_reachability( rtn.get() );
+
+		// The paths held should have been updated in-place.
+		//
+		for ( auto [a, b, path] : held )
+			CHECK( path->bits == rtn->compute_path( a, b ).bits );
+
+		// Delete a few blocks, unlinking them first. Paths through them are kept until the
+		// index is flushed.
+		//
+		for ( int n = 0; n != 4; n++ )
+		{
+			basic_block* block = rtn->find_block( 1 + rng() % ( count - 1 ) );
+			if ( !block )
+				continue;
+			for ( basic_block* prev : std::vector{ block->prev } )
+				if ( prev != block )
+					prev->next.erase( std::find( prev->next.begin(), prev->next.end(), block ) );
+			for ( basic_block* next : std::vector{ block->next } )
+				if ( next != block )
+					next->prev.erase( std::find( next->prev.begin(), next->prev.end(), block ) );
+			block->prev.clear();
+			block->next.clear();
+			rtn->delete_block( block );
+		}
+		check_reachability( rtn.get(), false );
+		rtn->flush_paths();
+		check_reachability( rtn.get() );
+	}
+}
+
+DOCTEST_TEST_CASE( "routine: destroying a routine purges the shared simplifier cache" )
+{
+	REQUIRE( !symbolic::get_shared_simplifier_cache() );
+	symbolic::set_shared_simplifier_cache( true );
+
+	// Simplifies the expression with a cold thread cache, returning the number of shared hits.
+	//
+	symbolic::unique_identifier uid = std::string{ "purge_probe" };
+	const auto shared_hits = [ & ] ()
+	{
+		symbolic::purge_simplifier_state();
+		symbolic::reset_simplifier_cache_stats();
+		symbolic::expression::reference var = { uid, 64 };
+		symbolic::expression::reference exp = ( ( var + 7 ) ^ var ) - ( var | 3 );
+		exp.simplify();
+		return symbolic::get_simplifier_cache_stats().shared_hits;
+	};
+
+	shared_hits();
+	CHECK( shared_hits() != 0 );
+
+	delete basic_block::begin( 0 )->owner;
+	CHECK( shared_hits() == 0 );
+	CHECK( shared_hits() != 0 );
+
+	symbolic::set_shared_simplifier_cache( false );
+	CHECK( shared_hits() == 0 );
+}
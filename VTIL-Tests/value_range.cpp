@@ -0,0 +1,258 @@
+// Copyright (c) 2020 Can Boluk and contributors of the VTIL Project
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+// 3. Neither the name of VTIL nor the names of its
+//    contributors may be used to endorse or promote products derived from
+//    this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include "doctest.h"
+#include <vtil/vtil>
+#include <random>
+#include <numeric>
+
+using namespace vtil;
+
+namespace
+{
+	// Operand shape used to generate a range along with the concrete values it contains.
+	//
+	struct operand_sample
+	{
+		bitcnt_t bcnt;
+		math::value_range range;
+		std::vector<uint64_t> values;
+	};
+
+	// Generates a random operand of the given size, either a partially known bit-vector, a strided
+	// hull of a few values clustered around a random point or a constant.
+	//
+	static operand_sample make_operand( std::mt19937_64& rng, bitcnt_t bcnt )
+	{
+		const uint64_t mask = math::fill( bcnt );
+		operand_sample result = { bcnt, {}, {} };
+
+		switch ( rng() % 3 )
+		{
+			case 0:
+			{
+				uint64_t unknown = rng() & rng() & mask;
+				uint64_t known_one = rng() & ~unknown & mask;
+				result.range = math::value_range::from_bits( { known_one, unknown, bcnt } );
+				for ( int i = 0; i != 16; i++ )
+					result.values.push_back( known_one | ( rng() & unknown ) );
+				break;
+			}
+			case 1:
+			{
+				uint64_t base = rng() & mask;
+				uint64_t stride = 1 + rng() % 8;
+				for ( int i = 0; i != 16; i++ )
+					result.values.push_back( ( base + stride * ( rng() % 32 ) ) & mask );
+
+				result.range = math::value_range::constant( result.values[ 0 ], bcnt );
+				for ( uint64_t value : result.values )
+				{
+					int64_t svalue = math::value_range::sx( value, bcnt );
+					result.range.umin = std::min( result.range.umin, value );
+					result.range.umax = std::max( result.range.umax, value );
+					result.range.smin = std::min( result.range.smin, svalue );
+					result.range.smax = std::max( result.range.smax, svalue );
+				}
+				for ( uint64_t value : result.values )
+					result.range.stride = std::gcd( result.range.stride, value - result.range.umin );
+				break;
+			}
+			case 2:
+			{
+				result.values.push_back( rng() & mask );
+				result.range = math::value_range::constant( result.values[ 0 ], bcnt );
+				break;
+			}
+		}
+		return result;
+	}
+};
+
+DOCTEST_TEST_CASE( "value_range: operator ranges contain the evaluated results" )
+{
+	static constexpr math::operator_id binary_operators[] = {
+		math::operator_id::add,         math::operator_id::subtract,    math::operator_id::multiply,
+		math::operator_id::umultiply,   math::operator_id::bitwise_and, math::operator_id::bitwise_or,
+		math::operator_id::bitwise_xor, math::operator_id::udivide,     math::operator_id::uremainder,
+		math::operator_id::greater,     math::operator_id::greater_eq,  math::operator_id::less,
+		math::operator_id::less_eq,     math::operator_id::ugreater,    math::operator_id::ugreater_eq,
+		math::operator_id::uless,       math::operator_id::uless_eq,    math::operator_id::equal,
+		math::operator_id::not_equal,   math::operator_id::uequal,      math::operator_id::unot_equal,
+	};
+	static constexpr bitcnt_t sizes[] = { 1, 8, 16, 32, 64 };
+
+	std::mt19937_64 rng( 0x5641545241474e45 );
+	size_t checked = 0;
+
+	// Checks that every combination of the sampled operand values evaluates into the computed range.
+	//
+	const auto check = [ & ] ( math::operator_id op, const operand_sample& lhs, const operand_sample& rhs )
+	{
+		for ( uint64_t a : lhs.values )
+		{
+			for ( uint64_t b : rhs.values )
+			{
+				// Skip division by zero, it has no defined result.
+				//
+				if ( ( op == math::operator_id::udivide || op == math::operator_id::uremainder ) && !b )
+					continue;
+
+				auto [result, bcnt_res] = math::evaluate( op, lhs.bcnt, a, rhs.bcnt, b );
+				math::value_range range = math::evaluate_range( op, lhs.bcnt, lhs.range, rhs.bcnt, rhs.range, bcnt_res );
+				if ( !range.contains( result, bcnt_res ) )
+				{
+					DOCTEST_FAIL_CHECK( math::descriptor_of( op ).function_name << ": " << a << " (" << lhs.bcnt << ") and " << b << " (" << rhs.bcnt << ") evaluate to " << result
+										<< " outside [" << range.umin << ", " << range.umax << "] / [" << range.smin << ", " << range.smax << "] stride " << range.stride );
+					return;
+				}
+				checked++;
+			}
+		}
+	};
+
+	for ( int iteration = 0; iteration != 2000; iteration++ )
+	{
+		bitcnt_t bcnt = sizes[ rng() % std::size( sizes ) ];
+
+		// Binary operators on operands of equal size, with an occasional mismatch to check that
+		// unhandled sizes fall back to a sound range.
+		//
+		for ( math::operator_id op : binary_operators )
+		{
+			bitcnt_t bcnt_rhs = ( rng() % 8 ) ? bcnt : sizes[ rng() % std::size( sizes ) ];
+			check( op, make_operand( rng, bcnt ), make_operand( rng, bcnt_rhs ) );
+		}
+
+		// Unary operators.
+		//
+		for ( math::operator_id op : { math::operator_id::negate, math::operator_id::bitwise_not } )
+			check( op, { 0, math::value_range::constant( 0, 1 ), { 0 } }, make_operand( rng, bcnt ) );
+
+		// Shifts, with a count that is frequently but not always below the operand size.
+		//
+		for ( math::operator_id op : { math::operator_id::shift_left, math::operator_id::shift_right } )
+		{
+			operand_sample count = make_operand( rng, 8 );
+			if ( rng() % 4 )
+			{
+				uint64_t limit = bcnt + 1;
+				for ( uint64_t& value : count.values )
+					value %= limit;
+				if ( count.range.umax >= limit )
+					count.range = math::value_range::full( 8 );
+				if ( rng() & 1 )
+				{
+					count.values = { count.values[ 0 ] };
+					count.range = math::value_range::constant( count.values[ 0 ], 8 );
+				}
+			}
+			check( op, make_operand( rng, bcnt ), count );
+		}
+
+		// Conditional value with a boolean or wider condition.
+		//
+		check( math::operator_id::value_if, make_operand( rng, ( rng() & 1 ) ? 1 : bcnt ), make_operand( rng, bcnt ) );
+
+		// Resizing operators to every size.
+		//
+		for ( math::operator_id op : { math::operator_id::ucast, math::operator_id::cast } )
+		{
+			bitcnt_t bcnt_res = sizes[ rng() % std::size( sizes ) ];
+			check( op, make_operand( rng, bcnt ), { 8, math::value_range::constant( bcnt_res, 8 ), { bcnt_res } } );
+		}
+	}
+	CHECK( checked != 0 );
+}
+
+DOCTEST_TEST_CASE( "value_range: expression ranges contain the evaluated results" )
+{
+	static constexpr math::operator_id operators[] = {
+		math::operator_id::add,         math::operator_id::subtract,    math::operator_id::multiply,
+		math::operator_id::bitwise_and, math::operator_id::bitwise_or,  math::operator_id::bitwise_xor,
+		math::operator_id::shift_right, math::operator_id::shift_left,  math::operator_id::udivide,
+		math::operator_id::uremainder,  math::operator_id::ugreater,    math::operator_id::less,
+		math::operator_id::equal,
+	};
+
+	std::mt19937_64 rng( 0x4e4f4953534552 );
+	symbolic::unique_identifier variables[] = { std::string{ "a" }, std::string{ "b" }, std::string{ "c" } };
+
+	// Creates a random bounded leaf, a variable masked and offset or shifted into a narrower range.
+	//
+	const auto make_leaf = [ & ] () -> symbolic::expression::reference
+	{
+		symbolic::expression::reference var = { variables[ rng() % std::size( variables ) ], 64 };
+		switch ( rng() % 4 )
+		{
+			case 0:  return ( var & symbolic::expression::reference{ rng() & 0xfff, 64 } ) + symbolic::expression::reference{ rng() & 0xff, 64 };
+			case 1:  return var >> symbolic::expression::reference{ 32 + rng() % 32, 8 };
+			case 2:  return ( var & symbolic::expression::reference{ 0xffull, 64 } ) | symbolic::expression::reference{ 1ull, 64 };
+			default: return symbolic::expression::reference{ rng() & 0xffff, 64 };
+		}
+	};
+
+	for ( int iteration = 0; iteration != 500; iteration++ )
+	{
+		// Build a small random tree over the leaves.
+		//
+		symbolic::expression::reference exp = make_leaf();
+		for ( int depth = rng() % 3; depth >= 0; depth-- )
+		{
+			math::operator_id op = operators[ rng() % std::size( operators ) ];
+			symbolic::expression::reference rhs = make_leaf();
+			if ( op == math::operator_id::shift_left || op == math::operator_id::shift_right )
+				rhs = symbolic::expression::reference{ rng() % 64, 8 };
+			else if ( op == math::operator_id::udivide || op == math::operator_id::uremainder )
+				rhs = rhs | symbolic::expression::reference{ 1ull, 64 };
+			exp = symbolic::expression{ exp.resize( 64 ), op, rhs };
+		}
+
+		// Evaluate the tree for random assignments of the variables.
+		//
+		for ( int assignment = 0; assignment != 32; assignment++ )
+		{
+			uint64_t values[ std::size( variables ) ];
+			for ( uint64_t& value : values )
+				value = rng();
+
+			math::bit_vector result = exp->evaluate( [ & ] ( const symbolic::unique_identifier& uid ) -> std::optional<uint64_t>
+			{
+				for ( size_t n = 0; n != std::size( variables ); n++ )
+					if ( variables[ n ] == uid )
+						return values[ n ];
+				return std::nullopt;
+			} );
+			REQUIRE( result.is_known() );
+			if ( !exp->range.contains( result.known_one(), exp->size() ) )
+			{
+				DOCTEST_FAIL_CHECK( exp->to_string() << " evaluates to " << result.known_one() << " outside [" << exp->range.umin << ", " << exp->range.umax << "]" );
+				break;
+			}
+		}
+	}
+}